@@ -1,119 +1,1193 @@
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE  // copy_file_range
 #include "archiver.h"
 #include "../Huffman/huffman.h"
+#include "../FileList/filelist.h"
 #include <pthread.h>
-#include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
 
-#define MAX_FILES 512
 static const char MAGIC[8] = "GSHAR100";
+static const char MAGIC_INDEX[8] = "GSHARIX3";
+static const char MAGIC_INDEX_V2[8] = "GSHARIX2";   // índice sin el hash del contenido
+static const char MAGIC_INDEX_V1[8] = "GSHARIDX";   // índice sin el hash ni los nanosegundos del mtime
 
-typedef struct { char path[1024]; char temp[64]; long size; } File;
-static File files[MAX_FILES];
-static int file_count = 0;
-static int next_job = 0;
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+// Formato .har:
+//   "GSHAR100", cantidad u32, y por entrada: tipo u8, largo ruta u16, ruta, y según el tipo:
+//     ENTRY_HUFF: tamaño comprimido u64, payload (.huff)
+//     ENTRY_RAW:  tamaño u64, el archivo tal cual (cuando comprimirlo no lo achica)
+//     ENTRY_SHARED: tamaño comprimido u64, payload comprimido con la tabla compartida
+//                (huffman_shared_encode), que está en la entrada ENTRY_TABLE
+//     ENTRY_TABLE: (ruta vacía, no es un archivo) tamaño u64, la tabla compartida del modo sólido
+//     ENTRY_REF | formato: posición u64 y tamaño u64 del payload de una entrada anterior con el
+//                mismo contenido; el resto del tipo dice el formato de ese payload
+//   Al final, índice central: por entrada tipo u8, largo ruta u16, ruta, posición del payload u64,
+//   tamaño comprimido u64, tamaño original u64, mtime i64 (segundos), nanosegundos del mtime u32,
+//   hash del contenido u64 (0 = no se conoce); y el pie de 24 bytes: posición del índice u64,
+//   largo del índice u64, "GSHARIX3".
+//   Los índices de versiones anteriores son iguales pero más cortos: "GSHARIX2" sin el hash y
+//   "GSHARIDX" sin el hash ni los nanosegundos.
+// El índice solo lo usan -l y -x; el resto lee las entradas en orden y no lo necesita. El decodificador
+// original no puede abrir estos .har: los payloads son .huff GSHUF200/GSHUF300 y las entradas pueden
+// ser ENTRY_RAW, ENTRY_SHARED, ENTRY_TABLE o ENTRY_REF, y no conoce ninguna de esas cosas.
+#define INDEX_FOOTER 24
+#define INDEX_RECORD 44        // bytes de un registro del índice después de la ruta
+#define INDEX_RECORD_V2 36
+#define INDEX_RECORD_V1 32
+#define NSEC_PER_SEC 1000000000LL
+#define ENTRY_HUFF 0
+#define ENTRY_RAW  1
+#define ENTRY_REF  2
+#define ENTRY_SHARED 4
+#define ENTRY_TABLE  8
+#define ENTRY_CODEC(type) ((type) & ~ENTRY_REF)
 
-static void scan_recursive(const char *base, const char *rel);
+// Tamaño original desconocido (.har sin índice)
+#define ORIG_UNKNOWN UINT64_MAX
 
-// Función worker de cada hilo
-static void* worker(void *arg) {
-    char *base = (char*)arg;
+// Dónde quedó el payload comprimido de una entrada dentro del .har (en una ENTRY_REF, el de
+// la entrada a la que apunta), el tipo de la entrada y el hash de su contenido (0 si el .har
+// no lo tiene)
+typedef struct { uint64_t off; uint64_t comp; int type; uint64_t hash; } HarSlot;
+
+// Entradas de un .har: rutas, tamaño original y mtime en una FileList, y en paralelo
+// (mismo índice) la posición de cada payload. No hay límite de cantidad ni de largo de ruta.
+typedef struct {
+    FileList files;
+    HarSlot *slots;
+    size_t slots_cap;
+} HarIndex;
+
+static void har_index_init(HarIndex *h) {
+    filelist_init(&h->files);
+    h->slots = NULL;
+    h->slots_cap = 0;
+}
+
+static void har_index_free(HarIndex *h) {
+    filelist_free(&h->files);
+    free(h->slots);
+    h->slots = NULL;
+    h->slots_cap = 0;
+}
+
+// Deja espacio en slots para todas las entradas de files. Devuelve 0 si OK, -1 si no hay memoria.
+static int har_index_reserve(HarIndex *h) {
+    if (h->files.count <= h->slots_cap) return 0;
+    size_t cap = h->files.cap > h->files.count ? h->files.cap : h->files.count;
+    HarSlot *bigger = realloc(h->slots, cap * sizeof(HarSlot));
+    if (!bigger) { perror("malloc"); return -1; }
+    h->slots = bigger;
+    h->slots_cap = cap;
+    return 0;
+}
+
+static int har_index_add(HarIndex *h, const char *path, size_t plen, uint64_t orig, int64_t mtime,
+                         uint64_t off, uint64_t comp, int type, uint64_t hash) {
+    if (filelist_add(&h->files, path, plen, orig, mtime) != 0) { perror("malloc"); return -1; }
+    if (har_index_reserve(h) != 0) { h->files.count--; return -1; }
+    h->slots[h->files.count - 1].off = off;
+    h->slots[h->files.count - 1].comp = comp;
+    h->slots[h->files.count - 1].type = type;
+    h->slots[h->files.count - 1].hash = hash;
+    return 0;
+}
+
+// Copia len bytes de in (desde in_off) a out (en out_off) sin pasar por memoria del proceso:
+// copy_file_range deja que el kernel (o el sistema de archivos, con reflinks) haga la copia.
+// Si no está disponible entre estos archivos, se copia con pread/pwrite.
+static int copy_range(int in, off_t in_off, int out, off_t out_off, size_t len) {
+    while (len > 0) {
+        ssize_t n = copy_file_range(in, &in_off, out, &out_off, len, 0);
+        if (n > 0) { len -= (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)) return -1;
+        break;
+    }
+    if (len == 0) return 0;
+
+    char *buf = malloc(1 << 20);
+    if (!buf) return -1;
+    int r = 0;
+    while (r == 0 && len > 0) {
+        size_t n = len < (1 << 20) ? len : (1 << 20);
+        r = pread_all(in, buf, n, in_off) == 0 && pwrite_all(out, buf, n, out_off) == 0 ? 0 : -1;
+        in_off += n; out_off += n; len -= n;
+    }
+    free(buf);
+    return r;
+}
+
+// Búsqueda de entradas por ruta (para --update): tabla hash abierta con los índices de un
+// HarIndex, armada una vez y después solo de lectura, así que varios hilos la pueden usar.
+typedef struct { size_t *slots; size_t mask; } PathTable;
+
+static uint64_t hash_path(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;   // FNV-1a
+    for (size_t i = 0; i < len; i++) { h ^= (unsigned char)s[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+static int path_table_build(PathTable *t, const HarIndex *h) {
+    size_t cap = 16;
+    while (cap < h->files.count * 2) cap *= 2;
+    t->slots = calloc(cap, sizeof(size_t));   // guardan índice + 1; 0 = vacío
+    t->mask = cap - 1;
+    if (!t->slots) { perror("malloc"); return -1; }
+    for (size_t i = 0; i < h->files.count; i++) {
+        const char *p = filelist_path(&h->files, i);
+        size_t k = hash_path(p, strlen(p)) & t->mask;
+        while (t->slots[k]) k = (k + 1) & t->mask;
+        t->slots[k] = i + 1;
+    }
+    return 0;
+}
+
+// Índice de la entrada con esa ruta, o -1 si no está
+static long path_table_find(const PathTable *t, const HarIndex *h, const char *path, size_t len) {
+    size_t k = hash_path(path, len) & t->mask;
+    while (t->slots[k]) {
+        size_t i = t->slots[k] - 1;
+        if (strcmp(filelist_path(&h->files, i), path) == 0) return (long)i;
+        k = (k + 1) & t->mask;
+    }
+    return -1;
+}
+
+static int load_entries(int fd, off_t file_size, HarIndex *h);
+
+// Hash rápido (no criptográfico) del contenido de un archivo, para encontrar duplicados:
+// cuatro acumuladores independientes de 64 bits, así el procesador avanza 32 bytes por vuelta.
+// Un choque solo hace que se compare byte a byte; nunca se confía solo en el hash.
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static uint64_t hash_content(const uint8_t *p, size_t n) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ULL, P2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t h[4] = { P1 + P2, P2, 0, -P1 }, w;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            memcpy(&w, p + i + 8 * k, 8);
+            h[k] = rotl64(h[k] + w * P2, 31) * P1;
+        }
+    }
+    uint64_t r = n + rotl64(h[0], 1) + rotl64(h[1], 7) + rotl64(h[2], 12) + rotl64(h[3], 18);
+    for (int k = 0; k < 4; k++) r = (r ^ (rotl64(h[k] * P2, 31) * P1)) * P1 + P2;
+    for (; i < n; i++) r = rotl64(r ^ (p[i] * P1), 11) * P2;
+    r ^= r >> 33; r *= P2; r ^= r >> 29; r *= P1; r ^= r >> 32;
+    return r;
+}
+
+// Cola de trabajo entre el hilo que recorre la carpeta y los que comprimen: el recorrido deja
+// como mucho HAR_QUEUE_CAP archivos esperando, así la memoria no depende del tamaño del árbol.
+// Los hilos pueden pasarse de ese tope al devolver un archivo grande ya repartido en bloques.
+// (Si el hilo del recorrido no se pudo crear, la carpeta se recorre antes y la cola no tiene tope.)
+#ifndef HAR_QUEUE_CAP
+#define HAR_QUEUE_CAP 4096
+#endif
+
+// Archivo grande repartido en bloques: cada bloque es una tarea aparte que puede tomar
+// cualquier hilo. El hilo que termina el último bloque arma la entrada, la escribe y libera esto.
+// Lo reparte el hilo que calculó su hash, solo si no es un duplicado y vale la pena comprimirlo.
+typedef struct {
+    char *path;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+    uint8_t **blocks;       // bloques comprimidos (formato de huffman_encode_block)
+    size_t *lens;
+    uint32_t nblocks;
+    uint32_t remaining;     // bloques sin terminar (con el candado)
+    int failed;
+    struct DedupEntry *owner;   // dónde avisar que el payload está escrito (o NULL)
+} SplitFile;
+
+// Un archivo en la cola. Si ya está repartido en bloques (split != NULL) sigue en la cola
+// hasta que se reparten todos; next_block es el siguiente por repartir. Si no cambió desde
+// el .har anterior (reuse != NULL), su payload comprimido se copia tal cual de ahí.
+// Si no vale la pena comprimirlo, se guarda entero aunque sea grande.
+typedef struct {
+    char *path;
+    uint64_t size;
+    int64_t mtime;
+    SplitFile *split;
+    uint32_t next_block;
+    const HarSlot *reuse;
+} QueueItem;
+
+// Deduplicación: cada contenido distinto (mismo hash, tamaño y bytes) se comprime una sola vez.
+// El primer archivo con ese contenido queda como dueño y los siguientes se guardan como
+// ENTRY_REF a su payload. Si el dueño todavía se está comprimiendo, los duplicados quedan en
+// su lista de espera y los escribe él al terminar, así ningún hilo se bloquea esperando a otro.
+// Con HAR_UPDATE, un archivo sin cambios entra con el hash que guardó el índice del .har anterior,
+// sin leerlo: si el dueño tiene el mismo payload del .har anterior es igual sin comparar nada, y si
+// no se comparan los dos payloads comprimidos.
+typedef struct DedupRef {
+    char *path;
+    uint64_t size;
+    int64_t mtime;
+    const HarSlot *reuse;       // archivo sin cambios: su payload en el .har anterior (o NULL)
+    struct DedupRef *next;
+} DedupRef;
+
+typedef struct DedupEntry {
+    uint64_t hash;
+    uint64_t size;
+    char *path;                 // archivo dueño, para comparar byte a byte
+    const HarSlot *old;         // si el dueño es un archivo sin cambios: su payload en el .har anterior
+    int done;                   // su payload ya está escrito en off/comp
+    uint64_t off, comp;
+    int type;                   // formato del payload (ENTRY_HUFF, ENTRY_RAW o ENTRY_SHARED)
+    DedupRef *waiting;          // duplicados que esperan a que termine el dueño
+    struct DedupEntry *next;    // siguiente en el mismo balde
+} DedupEntry;
+
+// Tabla hash por (hash, tamaño); crece al doble para mantener ~1 entrada por balde
+typedef struct {
+    DedupEntry **buckets;
+    size_t nbuckets;
+    size_t count;
+} DedupTable;
+
+// Estado de una compresión de carpeta. Cada llamada tiene el suyo, así que se pueden
+// comprimir varias carpetas a la vez desde distintos hilos del mismo proceso.
+typedef struct {
+    const char *base;       // carpeta de entrada
+    HarIndex *index;        // entradas ya escritas, en el orden del .har (con el candado)
+    QueueItem **queue;      // heap: el archivo más grande que ya se encontró, arriba
+    size_t queue_len, queue_cap;
+    int scan_done;          // el recorrido terminó: cuando la cola se vacíe no hay más trabajo...
+    int busy;               // ...ni hilos trabajando, que pueden devolver bloques a la cola
+    int scan_inline;        // el recorrido corre antes que los que comprimen: la cola no tiene tope
+    int fd;                 // .har de salida, compartido por los hilos
+    off_t off;              // siguiente byte libre del .har (se reserva con el candado)
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    // Solo con HAR_UPDATE: el .har anterior y sus entradas por ruta
+    int old_fd;
+    const HarIndex *old;
+    PathTable old_paths;
+    size_t reused;          // entradas copiadas del .har anterior (con el candado)
+    DedupTable dedup;       // contenidos ya vistos (con el candado)
+    size_t duplicates;      // entradas guardadas como ENTRY_REF (con el candado)
+    HuffShared *shared;     // solo con HAR_SOLID: tabla compartida (de solo lectura)
+    int old_table;          // la tabla es la del .har anterior: sus ENTRY_SHARED se pueden copiar
+    size_t tables;          // entradas ENTRY_TABLE (no son archivos)
+} CompressJob;
+
+static void job_fail(CompressJob *job) {
+    pthread_mutex_lock(&job->lock);
+    job->error = 1;
+    pthread_cond_broadcast(&job->not_empty);
+    pthread_cond_broadcast(&job->not_full);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void free_split(SplitFile *sf) {
+    for (uint32_t b = 0; sf->blocks && b < sf->nblocks; b++) free(sf->blocks[b]);
+    free(sf->blocks);
+    free(sf->lens);
+    free(sf->path);
+    free(sf);
+}
+
+// Heap por tamaño (el más grande en queue[0]); se usa con el candado tomado
+static void queue_swap(CompressJob *job, size_t i, size_t j) {
+    QueueItem *t = job->queue[i]; job->queue[i] = job->queue[j]; job->queue[j] = t;
+}
+
+static int queue_push(CompressJob *job, QueueItem *it) {
+    if (job->queue_len == job->queue_cap) {
+        size_t cap = job->queue_cap ? job->queue_cap * 2 : 256;
+        QueueItem **q = realloc(job->queue, cap * sizeof(QueueItem*));
+        if (!q) return -1;
+        job->queue = q;
+        job->queue_cap = cap;
+    }
+    size_t i = job->queue_len++;
+    job->queue[i] = it;
+    while (i > 0 && job->queue[(i - 1) / 2]->size < job->queue[i]->size) {
+        queue_swap(job, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    return 0;
+}
+
+static void queue_pop(CompressJob *job) {
+    job->queue[0] = job->queue[--job->queue_len];
+    size_t i = 0;
     while (1) {
-        pthread_mutex_lock(&lock);
-        if (next_job >= file_count) { pthread_mutex_unlock(&lock); break; }
-        int idx = next_job++;
-        pthread_mutex_unlock(&lock);
-        
-        sprintf(files[idx].temp, ".tmp_%d.huf", idx);
-        char full[2048];
-        sprintf(full, "%s/%s", base, files[idx].path);
-        compress_file(full, files[idx].temp);
-        struct stat st;
-        if (stat(files[idx].temp, &st) == 0) files[idx].size = st.st_size;
+        size_t l = 2 * i + 1, r = l + 1, big = i;
+        if (l < job->queue_len && job->queue[l]->size > job->queue[big]->size) big = l;
+        if (r < job->queue_len && job->queue[r]->size > job->queue[big]->size) big = r;
+        if (big == i) break;
+        queue_swap(job, i, big);
+        i = big;
     }
+}
+
+// Reserva el lugar de la entrada en el .har (encabezado + size bytes de payload), la agrega
+// al índice (con el hash de su contenido) y escribe su encabezado. En *payload queda dónde va
+// el payload. Devuelve 0 si OK, -1 si error.
+static int write_entry_header(CompressJob *job, int type, const char *path, uint64_t orig, int64_t mtime,
+                              uint64_t hash, uint64_t size, off_t *payload) {
+    unsigned short plen = strlen(path);
+    size_t hlen = 3 + plen + 8;
+
+    // Encabezado de la entrada: tipo, largo de la ruta, ruta, tamaño comprimido
+    unsigned char *hdr = malloc(hlen);
+    if (!hdr) { perror("malloc"); return -1; }
+    unsigned long size_ul = size;
+    hdr[0] = type;
+    memcpy(hdr + 1, &plen, 2);
+    memcpy(hdr + 3, path, plen);
+    memcpy(hdr + 3 + plen, &size_ul, 8);
+
+    pthread_mutex_lock(&job->lock);
+    off_t off = job->off;
+    job->off += hlen + size;
+    int r = har_index_add(job->index, path, plen, orig, mtime, off + hlen, size, type, hash);
+    pthread_mutex_unlock(&job->lock);
+
+    if (r == 0 && pwrite_all(job->fd, hdr, hlen, off) != 0) { perror("write"); r = -1; }
+    free(hdr);
+    *payload = off + hlen;
+    return r;
+}
+
+// Escribe una entrada cuyo payload viene en npieces pedazos seguidos. En *slot queda
+// dónde quedó el payload (para que los duplicados apunten ahí).
+static int write_entry(CompressJob *job, int type, const char *path, uint64_t orig, int64_t mtime, uint64_t hash,
+                       uint8_t *const *pieces, const size_t *lens, size_t npieces, HarSlot *slot) {
+    uint64_t size = 0;
+    for (size_t i = 0; i < npieces; i++) size += lens[i];
+    off_t pos;
+    int r = write_entry_header(job, type, path, orig, mtime, hash, size, &pos);
+    slot->off = pos;
+    slot->comp = size;
+    slot->type = type;
+    slot->hash = hash;
+    for (size_t i = 0; r == 0 && i < npieces; i++) {
+        r = pwrite_all(job->fd, pieces[i], lens[i], pos);
+        if (r != 0) perror("write");
+        pos += lens[i];
+    }
+    return r;
+}
+
+// Entrada duplicada: solo el encabezado, apuntando al payload que ya está en el .har
+static int write_ref(CompressJob *job, const char *path, uint64_t orig, int64_t mtime, const HarSlot *target) {
+    unsigned short plen = strlen(path);
+    size_t hlen = 3 + plen + 16;
+    unsigned char *hdr = malloc(hlen);
+    if (!hdr) { perror("malloc"); return -1; }
+    hdr[0] = ENTRY_REF | target->type;
+    memcpy(hdr + 1, &plen, 2);
+    memcpy(hdr + 3, path, plen);
+    memcpy(hdr + 3 + plen, &target->off, 8);
+    memcpy(hdr + 3 + plen + 8, &target->comp, 8);
+
+    pthread_mutex_lock(&job->lock);
+    off_t off = job->off;
+    job->off += hlen;
+    int r = har_index_add(job->index, path, plen, orig, mtime, target->off, target->comp, ENTRY_REF | target->type, target->hash);
+    if (r == 0) job->duplicates++;
+    pthread_mutex_unlock(&job->lock);
+
+    if (r == 0 && pwrite_all(job->fd, hdr, hlen, off) != 0) { perror("write"); r = -1; }
+    free(hdr);
+    return r;
+}
+
+// Mapea entero el archivo rel de la carpeta de entrada, que tiene que seguir midiendo size
+// bytes (size > 0). Devuelve NULL si no se pudo.
+static uint8_t* map_input(const CompressJob *job, const char *rel, uint64_t size) {
+    char *full = path_join(job->base, rel);
+    int fd = full ? open(full, O_RDONLY) : -1;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && (uint64_t)st.st_size == size)
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) fprintf(stderr, "Error leyendo %s\n", full ? full : rel);
+    if (fd >= 0) close(fd);
+    free(full);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+// Muestras para decidir si comprimir: hasta RAW_SAMPLES pedazos de RAW_SAMPLE_LEN bytes
+// repartidos por el archivo (o el archivo entero si es más chico que eso)
+#define RAW_SAMPLES 16
+#define RAW_SAMPLE_LEN 4096
+
+// Lo que suma un .huff de un bloque además de los bits: magic, tamaño y tabla (a lo sumo)
+#define HUFF_OVERHEAD (8 + 10 + 1 + 32 + 256)
+
+// Suma a freq el histograma de las muestras de map[0..size) y devuelve cuántos bytes se contaron
+static uint64_t sample_histogram(const uint8_t *map, uint64_t size, uint64_t freq[256]) {
+    if (size <= RAW_SAMPLES * RAW_SAMPLE_LEN) {
+        huffman_histogram(map, size, freq);
+        return size;
+    }
+    uint64_t step = (size - RAW_SAMPLE_LEN) / (RAW_SAMPLES - 1);
+    for (int i = 0; i < RAW_SAMPLES; i++) huffman_histogram(map + i * step, RAW_SAMPLE_LEN, freq);
+    return RAW_SAMPLES * RAW_SAMPLE_LEN;
+}
+
+// Bytes que ocuparía el archivo entero si las muestras (sampled bytes) ocupan bits bits
+static uint64_t estimate_size(uint64_t bits, uint64_t sampled, uint64_t size) {
+    return sampled ? (uint64_t)((double)bits / 8 / sampled * size) : 0;
+}
+
+// Formato para guardar el archivo: con el histograma de las muestras se calcula cuánto ocuparía
+// con sus propios códigos de Huffman (más la tabla y el encabezado del .huff) y, en modo sólido,
+// con la tabla compartida. Si ninguno ahorra al menos 1/64 del tamaño no vale la pena el costo
+// de comprimir y descomprimir: los archivos ya comprimidos (imágenes, .gz, cifrados...) y los
+// muy chicos se guardan tal cual.
+static int choose_codec(const CompressJob *job, const uint8_t *map, uint64_t size) {
+    uint64_t freq[256] = {0};
+    uint64_t sampled = sample_histogram(map, size, freq);
+    uint64_t best = size - size / 64;
+    int codec = ENTRY_RAW;
+    uint64_t own = estimate_size(huffman_estimate_bits(freq), sampled, size) + HUFF_OVERHEAD;
+    if (own < best) { best = own; codec = ENTRY_HUFF; }
+    if (job->shared && size <= HUFF_BLOCK_SIZE) {
+        uint64_t shared = estimate_size(huffman_shared_estimate_bits(job->shared, freq), sampled, size) + 1;
+        for (uint64_t v = size >> 7; v; v >>= 7) shared++;     // varint del tamaño
+        if (shared < best) codec = ENTRY_SHARED;
+    }
+    return codec;
+}
+
+// Lee el archivo una vez para su hash y para elegir cómo guardarlo
+static int inspect_input(const CompressJob *job, const char *rel, uint64_t size, uint64_t *hash, int *codec) {
+    if (size == 0) { *hash = hash_content(NULL, 0); *codec = ENTRY_RAW; return 0; }
+    uint8_t *map = map_input(job, rel, size);
+    if (!map) return -1;
+    *hash = hash_content(map, size);
+    *codec = choose_codec(job, map, size);
+    munmap(map, size);
+    return 0;
+}
+
+// 1 si los dos archivos tienen exactamente los mismos size bytes
+static int same_content(const CompressJob *job, const char *a, const char *b, uint64_t size) {
+    if (size == 0) return 1;
+    uint8_t *ma = map_input(job, a, size), *mb = ma ? map_input(job, b, size) : NULL;
+    int same = ma && mb && memcmp(ma, mb, size) == 0;
+    if (ma) munmap(ma, size);
+    if (mb) munmap(mb, size);
+    return same;
+}
+
+// 1 si el payload old del .har anterior tiene los mismos bytes y el mismo formato que el payload
+// slot ya escrito en el nuevo. Dos payloads así se extraen igual, así que sus archivos son iguales;
+// si se guardaron distinto (con otra versión, o uno tal cual) simplemente no se comparten.
+static int same_payload(const CompressJob *job, const HarSlot *old, const HarSlot *slot) {
+    if (old->comp != slot->comp || ENTRY_CODEC(old->type) != ENTRY_CODEC(slot->type)) return 0;
+    uint8_t *a = malloc(1 << 20), *b = malloc(1 << 20);
+    int same = a && b;
+    for (uint64_t done = 0; same && done < old->comp; ) {
+        size_t n = old->comp - done < (1 << 20) ? (size_t)(old->comp - done) : (1 << 20);
+        same = pread_all(job->old_fd, a, n, old->off + done) == 0
+            && pread_all(job->fd, b, n, slot->off + done) == 0 && memcmp(a, b, n) == 0;
+        done += n;
+    }
+    free(a);
+    free(b);
+    return same;
+}
+
+static DedupEntry* dedup_find(const DedupTable *t, uint64_t hash, uint64_t size) {
+    if (!t->nbuckets) return NULL;
+    for (DedupEntry *e = t->buckets[hash & (t->nbuckets - 1)]; e; e = e->next)
+        if (e->hash == hash && e->size == size) return e;
     return NULL;
 }
 
-// Escaneo recursivo de carpetas
-static void scan(const char *dir) {
-    scan_recursive(dir, "");
-}
-
-static void scan_recursive(const char *base, const char *rel) {
-    char path[2048];
-    sprintf(path, "%s%s%s", base, rel[0] ? "/" : "", rel);
-    
-    DIR *d = opendir(path);
-    if (!d) return;
-    struct dirent *e;
-    while ((e = readdir(d))) {
-        if (e->d_name[0] == '.' || file_count >= MAX_FILES) continue;
-        
-        char full[2048], relpath[1024];
-        sprintf(full, "%s/%s", path, e->d_name);
-        sprintf(relpath, "%s%s%s", rel, rel[0] ? "/" : "", e->d_name);
-        
-        struct stat st;
-        if (stat(full, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                scan_recursive(base, relpath);
-            } else if (S_ISREG(st.st_mode)) {
-                strncpy(files[file_count].path, relpath, sizeof(files[0].path)-1);
-                files[file_count].path[sizeof(files[0].path)-1] = 0;
-                files[file_count].size = st.st_size;
-                file_count++;
+// La entrada cuyo dueño es un archivo sin cambios con el payload old del .har anterior, o NULL
+static DedupEntry* dedup_find_old(const DedupTable *t, const HarSlot *old, uint64_t size) {
+    if (!t->nbuckets) return NULL;
+    for (DedupEntry *e = t->buckets[old->hash & (t->nbuckets - 1)]; e; e = e->next)
+        if (e->old && e->old->off == old->off && e->size == size) return e;
+    return NULL;
+}
+
+static int dedup_insert(DedupTable *t, DedupEntry *e) {
+    if (t->count >= t->nbuckets) {
+        size_t n = t->nbuckets ? t->nbuckets * 2 : 256;
+        DedupEntry **b = calloc(n, sizeof(DedupEntry*));
+        if (!b) return -1;
+        for (size_t i = 0; i < t->nbuckets; i++) {
+            for (DedupEntry *x = t->buckets[i], *next; x; x = next) {
+                next = x->next;
+                x->next = b[x->hash & (n - 1)];
+                b[x->hash & (n - 1)] = x;
             }
         }
+        free(t->buckets);
+        t->buckets = b;
+        t->nbuckets = n;
     }
-    closedir(d);
+    e->next = t->buckets[e->hash & (t->nbuckets - 1)];
+    t->buckets[e->hash & (t->nbuckets - 1)] = e;
+    t->count++;
+    return 0;
 }
 
-int compress_directory(const char *input_path, const char *output_path, int num_threads) {
-    file_count = 0; next_job = 0;
-    scan(input_path);
-    if (file_count == 0) { printf("Carpeta vacía\n"); return -1; }
-    printf("Comprimiendo %d archivos con %d hilos...\n", file_count, num_threads);
-    
-    pthread_t threads[32];
-    int nt = num_threads > 32 ? 32 : num_threads;
-    for (int i = 0; i < nt; i++) pthread_create(&threads[i], NULL, worker, (void*)input_path);
-    for (int i = 0; i < nt; i++) pthread_join(threads[i], NULL);
-    
-    int fd = open(output_path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
-    if (fd < 0) return -1;
-    write(fd, MAGIC, 8);
-    unsigned int count = file_count;
-    write(fd, &count, 4);
-    
-    char buf[8192];
-    for (int i = 0; i < file_count; i++) {
-        unsigned char type = 0;
-        unsigned short plen = strlen(files[i].path);
-        unsigned long size = files[i].size;
-        write(fd, &type, 1);
-        write(fd, &plen, 2);
-        write(fd, files[i].path, plen);
-        write(fd, &size, 8);
-        
-        int tf = open(files[i].temp, O_RDONLY);
-        if (tf >= 0) {
-            ssize_t n;
-            while ((n = read(tf, buf, sizeof(buf))) > 0) write(fd, buf, n);
-            close(tf);
-            unlink(files[i].temp);
+// Nueva entrada con path como dueño (con el candado tomado). Sin memoria devuelve NULL y el
+// archivo se guarda igual, solo que sin deduplicar.
+static DedupEntry* dedup_add(DedupTable *t, const char *path, uint64_t size, uint64_t hash, const HarSlot *old) {
+    DedupEntry *e = calloc(1, sizeof(DedupEntry));
+    if (e && (e->path = strdup(path)) != NULL) {
+        e->hash = hash;
+        e->size = size;
+        e->old = old;
+        if (dedup_insert(t, e) == 0) return e;
+    }
+    if (e) free(e->path);
+    free(e);
+    return NULL;
+}
+
+static void dedup_free(DedupTable *t) {
+    for (size_t i = 0; i < t->nbuckets; i++) {
+        for (DedupEntry *e = t->buckets[i], *next; e; e = next) {
+            next = e->next;
+            for (DedupRef *r = e->waiting, *rn; r; r = rn) { rn = r->next; free(r->path); free(r); }
+            free(e->path);
+            free(e);
         }
     }
-    close(fd);
-    printf("OK: %s\n", output_path);
+    free(t->buckets);
+}
+
+// Deja el archivo en la lista de espera de e (con el candado tomado). Devuelve 0 si OK, -1 si error.
+static int dedup_wait(DedupEntry *e, const char *path, uint64_t size, int64_t mtime, const HarSlot *reuse) {
+    DedupRef *r = malloc(sizeof(DedupRef));
+    char *p = strdup(path);
+    if (!r || !p) { free(r); free(p); perror("malloc"); return -1; }
+    r->path = p;
+    r->size = size;
+    r->mtime = mtime;
+    r->reuse = reuse;
+    r->next = e->waiting;
+    e->waiting = r;
     return 0;
 }
 
+// Busca un contenido igual ya visto. Devuelve 1 si el archivo es un duplicado y ya quedó
+// escrito (o en espera de su dueño), 0 si hay que comprimirlo (*owner: entrada donde avisar
+// al terminar, o NULL) y -1 si hubo error.
+static int dedup_claim(CompressJob *job, const char *path, uint64_t size, int64_t mtime,
+                       uint64_t hash, DedupEntry **owner) {
+    *owner = NULL;
+    pthread_mutex_lock(&job->lock);
+    DedupEntry *e = dedup_find(&job->dedup, hash, size);
+    if (!e) {
+        // Primero con este contenido: queda como dueño
+        *owner = dedup_add(&job->dedup, path, size, hash, NULL);
+        pthread_mutex_unlock(&job->lock);
+        return 0;
+    }
+    if (!e->done) {
+        int r = dedup_wait(e, path, size, mtime, NULL);
+        pthread_mutex_unlock(&job->lock);
+        return r == 0 ? 1 : -1;
+    }
+    HarSlot target = { e->off, e->comp, e->type, e->hash };
+    pthread_mutex_unlock(&job->lock);
+
+    // e->path no cambia una vez insertada, se puede leer sin el candado
+    if (!same_content(job, e->path, path, size)) return 0;   // mismo hash, distinto contenido
+    return write_ref(job, path, size, mtime, &target) == 0 ? 1 : -1;
+}
+
+static int store_content(CompressJob *job, const char *path, uint64_t size, int64_t mtime, uint64_t hash, int codec, DedupEntry *owner);
+static int copy_reused(CompressJob *job, const char *path, uint64_t size, int64_t mtime, const HarSlot *reuse, int compared);
+
+// El dueño ya escribió su payload en slot: de ahora en más los duplicados apuntan directo ahí,
+// y los que estaban esperando se escriben acá
+static int dedup_finish(CompressJob *job, DedupEntry *e, const HarSlot *slot) {
+    pthread_mutex_lock(&job->lock);
+    e->done = 1;
+    e->off = slot->off;
+    e->comp = slot->comp;
+    e->type = slot->type;
+    DedupRef *list = e->waiting;
+    e->waiting = NULL;
+    pthread_mutex_unlock(&job->lock);
+
+    int r = 0;
+    for (DedupRef *d = list, *next; d; d = next) {
+        next = d->next;
+        if (r != 0) {
+        } else if (d->reuse) {
+            // Sin cambios: el mismo payload del .har anterior que el dueño, o uno con los mismos bytes
+            if ((e->old && e->old->off == d->reuse->off) || same_payload(job, d->reuse, slot))
+                r = write_ref(job, d->path, d->size, d->mtime, slot);
+            else
+                r = copy_reused(job, d->path, d->size, d->mtime, d->reuse, 1);
+        } else if (same_content(job, e->path, d->path, d->size)) {
+            r = write_ref(job, d->path, d->size, d->mtime, slot);
+        } else {
+            // Mismo hash, distinto contenido: se guarda aparte, con su propio formato
+            uint64_t hash;
+            int codec;
+            r = inspect_input(job, d->path, d->size, &hash, &codec);
+            if (r == 0) r = store_content(job, d->path, d->size, d->mtime, hash, codec, NULL);
+        }
+        free(d->path);
+        free(d);
+    }
+    return r;
+}
+
+// Archivo completo: se comprime en memoria y se escribe de una vez
+static int compress_whole(CompressJob *job, const char *path, uint64_t size, int64_t mtime, uint64_t hash, HarSlot *slot) {
+    char *full = path_join(job->base, path);
+    uint8_t *data;
+    size_t len;
+    if (!full || compress_file_to_memory(full, &data, &len) != 0) {
+        fprintf(stderr, "Error comprimiendo %s\n", full ? full : path);
+        free(full);
+        return -1;
+    }
+    free(full);
+    int r = write_entry(job, ENTRY_HUFF, path, size, mtime, hash, &data, &len, 1, slot);
+    free(data);
+    return r;
+}
+
+// Archivo guardado tal cual (ENTRY_RAW): el kernel lo copia directo al .har, sin pasar por
+// la memoria del proceso
+static int store_raw(CompressJob *job, const char *path, uint64_t size, int64_t mtime, uint64_t hash, HarSlot *slot) {
+    char *full = path_join(job->base, path);
+    int fd = full ? open(full, O_RDONLY) : -1;
+    struct stat st;
+    off_t pos;
+    int r = -1;
+    if (fd < 0 || fstat(fd, &st) != 0 || (uint64_t)st.st_size != size) {
+        fprintf(stderr, "Error leyendo %s\n", full ? full : path);
+    } else if (write_entry_header(job, ENTRY_RAW, path, size, mtime, hash, size, &pos) == 0) {
+        r = copy_range(fd, 0, job->fd, pos, size);
+        if (r != 0) perror("copy");
+        slot->off = pos;
+        slot->comp = size;
+        slot->type = ENTRY_RAW;
+        slot->hash = hash;
+    }
+    if (fd >= 0) close(fd);
+    free(full);
+    return r;
+}
+
+// Modo sólido: solo los bits, con la tabla compartida
+static int store_shared(CompressJob *job, const char *path, uint64_t size, int64_t mtime, uint64_t hash, HarSlot *slot) {
+    uint8_t *map = map_input(job, path, size), *data;
+    size_t len;
+    if (!map) return -1;
+    int r = huffman_shared_encode(job->shared, map, size, &data, &len);
+    munmap(map, size);
+    if (r != 0) return -1;
+    r = write_entry(job, ENTRY_SHARED, path, size, mtime, hash, &data, &len, 1, slot);
+    free(data);
+    return r;
+}
+
+// Reparte un archivo grande en bloques: vuelve a la cola como tareas que puede tomar cualquier hilo
+static int queue_split(CompressJob *job, const char *path, uint64_t size, int64_t mtime, uint64_t hash, DedupEntry *owner) {
+    QueueItem *it = calloc(1, sizeof(QueueItem));
+    SplitFile *sf = calloc(1, sizeof(SplitFile));
+    uint32_t nblocks = (uint32_t)((size + HUFF_BLOCK_SIZE - 1) / HUFF_BLOCK_SIZE);
+    if (sf) {
+        sf->path = strdup(path);
+        sf->size = size;
+        sf->mtime = mtime;
+        sf->hash = hash;
+        sf->nblocks = sf->remaining = nblocks;
+        sf->owner = owner;
+        sf->blocks = calloc(nblocks, sizeof(uint8_t*));
+        sf->lens = calloc(nblocks, sizeof(size_t));
+    }
+    int r = -1;
+    if (it && sf && sf->path && sf->blocks && sf->lens) {
+        it->size = size;
+        it->mtime = mtime;
+        it->split = sf;
+        pthread_mutex_lock(&job->lock);
+        r = queue_push(job, it);
+        if (r == 0) pthread_cond_broadcast(&job->not_empty);   // un bloque para cada hilo libre
+        pthread_mutex_unlock(&job->lock);
+    }
+    if (r != 0) {
+        perror("malloc");
+        if (sf) free_split(sf);
+        free(it);
+    }
+    return r;
+}
+
+// Archivo sin repartir: se lee una vez para el hash y el formato (acá, en un hilo que comprime,
+// así el recorrido no se detiene en los archivos grandes) y solo se guarda si es el primero con
+// ese contenido. Uno grande que vale la pena comprimir se reparte en bloques entre todos los hilos.
+static int store_unique(CompressJob *job, const QueueItem *it) {
+    uint64_t hash;
+    int codec;
+    DedupEntry *owner;
+    if (inspect_input(job, it->path, it->size, &hash, &codec) != 0) return -1;
+    int r = dedup_claim(job, it->path, it->size, it->mtime, hash, &owner);
+    if (r != 0) return r > 0 ? 0 : -1;
+    return store_content(job, it->path, it->size, it->mtime, hash, codec, owner);
+}
+
+// Guarda el archivo con el formato codec y avisa a owner (si no es NULL) dónde quedó
+static int store_content(CompressJob *job, const char *path, uint64_t size, int64_t mtime, uint64_t hash, int codec, DedupEntry *owner) {
+    if (codec == ENTRY_HUFF && size > HUFF_BLOCK_SIZE) return queue_split(job, path, size, mtime, hash, owner);
+    HarSlot slot;
+    int r = codec == ENTRY_RAW ? store_raw(job, path, size, mtime, hash, &slot)
+          : codec == ENTRY_SHARED ? store_shared(job, path, size, mtime, hash, &slot)
+          : compress_whole(job, path, size, mtime, hash, &slot);
+    if (r != 0) return -1;
+    return owner ? dedup_finish(job, owner, &slot) : 0;
+}
+
+// Copia el payload reuse del .har anterior sin descomprimir ni comprimir, y con eso avisa a owner
+static int copy_payload(CompressJob *job, const char *path, uint64_t size, int64_t mtime,
+                        const HarSlot *reuse, DedupEntry *owner) {
+    off_t pos;
+    int type = ENTRY_CODEC(reuse->type);
+    if (write_entry_header(job, type, path, size, mtime, reuse->hash, reuse->comp, &pos) != 0) return -1;
+    if (copy_range(job->old_fd, reuse->off, job->fd, pos, reuse->comp) != 0) {
+        perror("copy");
+        return -1;
+    }
+    HarSlot slot = { pos, reuse->comp, type, reuse->hash };
+    return owner ? dedup_finish(job, owner, &slot) : 0;
+}
+
+// Archivo sin cambios, con la deduplicación hecha sin leerlo: entra con el hash guardado en el
+// índice anterior. Los que ahí compartían un payload lo siguen compartiendo (el primero en llegar
+// lo copia y los demás apuntan a la copia), y uno nuevo con el mismo contenido también apunta ahí.
+// Si el mismo hash ya lo tiene un archivo nuevo, se comparan los payloads comprimidos. compared = 1
+// si eso ya se hizo y no dio igual. Un .har anterior sin hashes se copia sin deduplicar.
+static int copy_reused(CompressJob *job, const char *path, uint64_t size, int64_t mtime,
+                       const HarSlot *reuse, int compared) {
+    if (!reuse->hash) return copy_payload(job, path, size, mtime, reuse, NULL);
+
+    pthread_mutex_lock(&job->lock);
+    DedupEntry *e = dedup_find_old(&job->dedup, reuse, size);
+    if (!e && !compared) {
+        e = dedup_find(&job->dedup, reuse->hash, size);
+        if (e && e->done) {
+            HarSlot target = { e->off, e->comp, e->type, e->hash };
+            pthread_mutex_unlock(&job->lock);
+            if (same_payload(job, reuse, &target)) return write_ref(job, path, size, mtime, &target);
+            pthread_mutex_lock(&job->lock);
+            e = dedup_find_old(&job->dedup, reuse, size);   // otro pudo haberlo copiado mientras
+        }
+    }
+    if (e && !e->done) {
+        int r = dedup_wait(e, path, size, mtime, reuse);
+        pthread_mutex_unlock(&job->lock);
+        return r;
+    }
+    if (e && e->old) {
+        HarSlot target = { e->off, e->comp, e->type, e->hash };
+        pthread_mutex_unlock(&job->lock);
+        return write_ref(job, path, size, mtime, &target);
+    }
+    DedupEntry *owner = dedup_add(&job->dedup, path, size, reuse->hash, reuse);
+    pthread_mutex_unlock(&job->lock);
+    return copy_payload(job, path, size, mtime, reuse, owner);
+}
+
+static int copy_entry(CompressJob *job, const QueueItem *it) {
+    pthread_mutex_lock(&job->lock);
+    job->reused++;
+    pthread_mutex_unlock(&job->lock);
+    return copy_reused(job, it->path, it->size, it->mtime, it->reuse, 0);
+}
+
+// Un bloque de un archivo grande. Si es el último en terminar, arma el .huff por bloques
+// (encabezado, bloques en orden, cola) y escribe la entrada.
+static int compress_split_block(CompressJob *job, SplitFile *sf, uint32_t block, uint8_t *buf) {
+    uint64_t start = (uint64_t)block * HUFF_BLOCK_SIZE;
+    size_t raw = sf->size - start < HUFF_BLOCK_SIZE ? (size_t)(sf->size - start) : HUFF_BLOCK_SIZE;
+
+    int ok = 0;
+    char *full = path_join(job->base, sf->path);
+    int fd = full ? open(full, O_RDONLY) : -1;
+    if (fd < 0 || pread_all(fd, buf, raw, start) != 0) {
+        fprintf(stderr, "Error leyendo %s\n", full ? full : sf->path);
+    } else if (huffman_encode_block(buf, raw, &sf->blocks[block], &sf->lens[block]) == 0) {
+        ok = 1;
+    }
+    if (fd >= 0) close(fd);
+    free(full);
+
+    pthread_mutex_lock(&job->lock);
+    if (!ok) sf->failed = 1;
+    int last = --sf->remaining == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (!last) return ok ? 0 : -1;
+
+    // Último bloque: los demás ya terminaron, nadie más toca sf
+    int r = -1;
+    if (!sf->failed) {
+        uint8_t **pieces = malloc((sf->nblocks + 2) * sizeof(uint8_t*));
+        size_t *lens = malloc((sf->nblocks + 2) * sizeof(size_t));
+        uint8_t head[8], *tail = NULL;
+        size_t tail_len;
+        if (pieces && lens && huffman_blocks_tail(sf->blocks, sf->nblocks, &tail, &tail_len) == 0) {
+            huffman_blocks_head(head);
+            pieces[0] = head;
+            lens[0] = sizeof(head);
+            memcpy(pieces + 1, sf->blocks, sf->nblocks * sizeof(uint8_t*));
+            memcpy(lens + 1, sf->lens, sf->nblocks * sizeof(size_t));
+            pieces[sf->nblocks + 1] = tail;
+            lens[sf->nblocks + 1] = tail_len;
+            HarSlot slot;
+            r = write_entry(job, ENTRY_HUFF, sf->path, sf->size, sf->mtime, sf->hash, pieces, lens, sf->nblocks + 2, &slot);
+            if (r == 0 && sf->owner) r = dedup_finish(job, sf->owner, &slot);
+        }
+        free(tail);
+        free(pieces);
+        free(lens);
+    }
+    free_split(sf);
+    return r;
+}
+
+// Función worker de cada hilo: toma el archivo más grande de la cola (o el siguiente bloque
+// de él, si es grande), lo comprime en memoria y escribe la entrada en su lugar reservado
+// del .har con pwrite. Las entradas quedan en el orden en que terminan, sin archivos temporales.
+static void* worker(void *arg) {
+    CompressJob *job = arg;
+    uint8_t *buf = NULL;    // bloque de entrada, solo si toca algún archivo grande
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        while (job->queue_len == 0 && (!job->scan_done || job->busy > 0) && !job->error)
+            pthread_cond_wait(&job->not_empty, &job->lock);
+        if (job->error || job->queue_len == 0) { pthread_mutex_unlock(&job->lock); break; }
+        QueueItem *it = job->queue[0];
+        SplitFile *sf = it->split;
+        uint32_t block = 0;
+        int done_with_item = 1;
+        if (sf) {
+            block = it->next_block++;
+            done_with_item = it->next_block == sf->nblocks;
+        }
+        if (done_with_item) {
+            queue_pop(job);
+            pthread_cond_signal(&job->not_full);
+        }
+        job->busy++;
+        pthread_mutex_unlock(&job->lock);
+
+        int r;
+        if (it->reuse) {
+            r = copy_entry(job, it);
+        } else if (!sf) {
+            r = store_unique(job, it);
+        } else {
+            if (!buf) buf = malloc(HUFF_BLOCK_SIZE);
+            r = buf ? compress_split_block(job, sf, block, buf) : -1;
+        }
+        if (done_with_item) {
+            free(it->path);
+            free(it);
+        }
+        pthread_mutex_lock(&job->lock);
+        if (--job->busy == 0 && job->queue_len == 0) pthread_cond_broadcast(&job->not_empty);
+        pthread_mutex_unlock(&job->lock);
+        if (r != 0) { job_fail(job); break; }
+    }
+    free(buf);
+    return NULL;
+}
+
+// Cada archivo que encuentra el recorrido entra a la cola (esperando si está llena), sin leerlo:
+// el hilo que lo toma decide si es un duplicado y si se reparte en bloques.
+static int enqueue_file(void *ctx, const char *rel, size_t len, uint64_t size, int64_t mtime) {
+    CompressJob *job = ctx;
+    QueueItem *it = calloc(1, sizeof(QueueItem));
+    char *path = malloc(len + 1);
+    if (!it || !path) { perror("malloc"); free(it); free(path); return -1; }
+    memcpy(path, rel, len + 1);
+    it->path = path;
+    it->size = size;
+    it->mtime = mtime;
+
+    // Con HAR_UPDATE: misma ruta, tamaño y mtime (al nanosegundo) que en el .har anterior = no cambió.
+    // Lo comprimido con la tabla compartida del .har anterior solo sirve si el nuevo sigue con esa tabla.
+    if (job->old) {
+        long i = path_table_find(&job->old_paths, job->old, rel, len);
+        if (i >= 0 && job->old->files.items[i].size == size && job->old->files.items[i].mtime == mtime
+            && (ENTRY_CODEC(job->old->slots[i].type) != ENTRY_SHARED || job->old_table))
+            it->reuse = &job->old->slots[i];
+    }
+
+    pthread_mutex_lock(&job->lock);
+    while (job->queue_len >= HAR_QUEUE_CAP && !job->scan_inline && !job->error)
+        pthread_cond_wait(&job->not_full, &job->lock);
+    int error = job->error;
+    if (!error && queue_push(job, it) != 0) { perror("malloc"); error = 1; }
+    if (!error) pthread_cond_signal(&job->not_empty);
+    pthread_mutex_unlock(&job->lock);
+    if (error) {
+        free(it->path);
+        free(it);
+        return -1;
+    }
+    return 0;
+}
+
+// Hilo que recorre la carpeta mientras los demás ya comprimen lo que va encontrando
+static void* scanner(void *arg) {
+    CompressJob *job = arg;
+    int r = filelist_walk(job->base, enqueue_file, job);
+    pthread_mutex_lock(&job->lock);
+    job->scan_done = 1;
+    if (r != 0) job->error = 1;
+    pthread_cond_broadcast(&job->not_empty);
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// Escribe el índice de todas las entradas en la posición off, seguido del pie
+static int write_index(int fd, off_t off, const HarIndex *h) {
+    size_t n = h->files.count;
+    size_t cap = INDEX_FOOTER + h->files.paths_len + n * (3 + INDEX_RECORD), len = 0;
+    unsigned char *buf = malloc(cap);
+    if (!buf) return -1;
+    for (size_t i = 0; i < n; i++) {
+        const char *path = filelist_path(&h->files, i);
+        unsigned short plen = strlen(path);
+        uint64_t pos = h->slots[i].off, comp = h->slots[i].comp, orig = h->files.items[i].size;
+        // El mtime se guarda en segundos (como antes) más los nanosegundos aparte
+        int64_t mtime = h->files.items[i].mtime / NSEC_PER_SEC;
+        int32_t nsec = (int32_t)(h->files.items[i].mtime % NSEC_PER_SEC);
+        if (nsec < 0) { nsec += NSEC_PER_SEC; mtime--; }
+        buf[len] = h->slots[i].type;
+        memcpy(buf + len + 1, &plen, 2);
+        memcpy(buf + len + 3, path, plen);
+        len += 3 + plen;
+        memcpy(buf + len, &pos, 8);
+        memcpy(buf + len + 8, &comp, 8);
+        memcpy(buf + len + 16, &orig, 8);
+        memcpy(buf + len + 24, &mtime, 8);
+        memcpy(buf + len + 32, &nsec, 4);
+        memcpy(buf + len + 36, &h->slots[i].hash, 8);
+        len += INDEX_RECORD;
+    }
+    uint64_t index_off = off, index_len = len;
+    memcpy(buf + len, &index_off, 8);
+    memcpy(buf + len + 8, &index_len, 8);
+    memcpy(buf + len + 16, MAGIC_INDEX, 8);
+    int r = pwrite_all(fd, buf, len + INDEX_FOOTER, off);
+    free(buf);
+    return r;
+}
+
+// Primera pasada del modo sólido: histograma conjunto (de las mismas muestras que usa
+// choose_codec) de los archivos de hasta un bloque que tengan algo para comprimir
+typedef struct {
+    const CompressJob *job;
+    uint64_t freq[256];
+    size_t files;
+} SolidScan;
+
+static int solid_sample(void *ctx, const char *rel, size_t len, uint64_t size, int64_t mtime) {
+    SolidScan *s = ctx;
+    (void)len; (void)mtime;
+    if (size == 0 || size > HUFF_BLOCK_SIZE) return 0;
+    uint8_t *map = map_input(s->job, rel, size);
+    if (!map) return 0;     // si sigue sin poder leerse, falla al comprimirlo
+    uint64_t freq[256] = {0};
+    uint64_t sampled = sample_histogram(map, size, freq);
+    munmap(map, size);
+    // Los incompresibles no cuentan: aplanarían la tabla de todos los demás
+    if (estimate_size(huffman_estimate_bits(freq), sampled, size) >= size - size / 64) return 0;
+    for (int i = 0; i < 256; i++) s->freq[i] += freq[i];
+    s->files++;
+    return 0;
+}
+
+// Arma la tabla compartida recorriendo la carpeta una vez antes de comprimir.
+// Devuelve 0 si OK (job->shared queda NULL si no hay archivos que la usen), -1 si error.
+static int build_shared_table(CompressJob *job) {
+    SolidScan *s = calloc(1, sizeof(SolidScan));
+    if (!s) { perror("malloc"); return -1; }
+    s->job = job;
+    int r = filelist_walk(job->base, solid_sample, s);
+    if (r == 0 && s->files > 0) {
+        job->shared = huffman_shared_build(s->freq);
+        if (!job->shared) { perror("malloc"); r = -1; }
+    }
+    free(s);
+    return r;
+}
+
+// Carga la tabla compartida si el .har tiene una (si no, *shared queda NULL).
+// Devuelve 0 si OK, -1 si la tabla está dañada.
+static int load_shared(int fd, const HarIndex *h, HuffShared **shared) {
+    *shared = NULL;
+    for (size_t i = 0; i < h->files.count; i++) {
+        const HarSlot *e = &h->slots[i];
+        if (e->type != ENTRY_TABLE) continue;
+        unsigned char *buf = malloc(e->comp ? e->comp : 1);
+        if (buf && pread_all(fd, buf, e->comp, e->off) == 0) *shared = huffman_shared_load(buf, e->comp);
+        free(buf);
+        if (!*shared) fprintf(stderr, "Error: tabla compartida del .har dañada\n");
+        return *shared ? 0 : -1;
+    }
+    return 0;
+}
+
+// Con HAR_SOLID y HAR_UPDATE sobre un .har que ya tiene tabla, se sigue usando esa: así sus
+// ENTRY_SHARED sin cambios se copian tal cual y solo lo nuevo se comprime (con la tabla vieja,
+// que tiene código para todos los bytes). Si no, se arma una tabla para esta carpeta.
+static int prepare_shared_table(CompressJob *job) {
+    if (job->old && load_shared(job->old_fd, job->old, &job->shared) == 0 && job->shared) {
+        job->old_table = 1;
+        return 0;
+    }
+    return build_shared_table(job);
+}
+
+// La tabla compartida va como una entrada más (ENTRY_TABLE, sin ruta)
+static int write_shared_table(CompressJob *job) {
+    uint8_t *table;
+    size_t len;
+    HarSlot slot;
+    if (huffman_shared_save(job->shared, &table, &len) != 0) { perror("malloc"); return -1; }
+    int r = write_entry(job, ENTRY_TABLE, "", 0, 0, 0, &table, &len, 1, &slot);
+    free(table);
+    if (r == 0) job->tables++;
+    return r;
+}
+
+// Con HAR_UPDATE se lee el .har que ya está en output_path. El nuevo se escribe en un temporal
+// al lado y al final reemplaza al anterior con rename, así nunca queda un .har a medias.
+int compress_directory_flags(const char *input_path, const char *output_path, int num_threads, int flags) {
+    CompressJob *job = calloc(1, sizeof(CompressJob));
+    if (!job) { perror("malloc"); return -1; }
+    HarIndex index, old;
+    har_index_init(&index);
+    har_index_init(&old);
+    job->base = input_path;
+    job->index = &index;
+    job->old_fd = -1;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->not_empty, NULL);
+    pthread_cond_init(&job->not_full, NULL);
+
+    char *temp_path = NULL;
+    struct stat st;
+    if (flags & HAR_UPDATE) {
+        job->old_fd = open(output_path, O_RDONLY);
+        if (job->old_fd >= 0 && fstat(job->old_fd, &st) == 0 && is_har_archive(output_path)
+            && load_entries(job->old_fd, st.st_size, &old) == 0 && path_table_build(&job->old_paths, &old) == 0) {
+            job->old = &old;
+        } else if (job->old_fd >= 0) {
+            fprintf(stderr, "Aviso: no se pudo leer %s, se comprime todo de nuevo\n", output_path);
+        }
+        temp_path = malloc(strlen(output_path) + 8);
+        if (temp_path) {
+            sprintf(temp_path, "%s.XXXXXX", output_path);
+            job->fd = mkstemp(temp_path);
+            if (job->fd >= 0) fchmod(job->fd, 0644);
+        } else {
+            job->fd = -1;
+        }
+    } else {
+        job->fd = open(output_path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
+    }
+    const char *write_path = temp_path ? temp_path : output_path;
+
+    int error = 0;
+    size_t count = 0, files = 0;
+    if (job->fd < 0) {
+        perror("open output");
+        error = 1;
+        goto done;
+    }
+    // La cantidad de entradas se escribe al final, cuando se conoce
+    unsigned char head[12] = {0};
+    memcpy(head, MAGIC, 8);
+    job->off = sizeof(head);
+    if ((flags & HAR_SOLID) && prepare_shared_table(job) != 0) job->error = 1;
+    else if (job->shared && write_shared_table(job) != 0) job->error = 1;
+
+    int nt = num_threads > MAX_THREADS ? MAX_THREADS : num_threads;
+    if (nt < 1) nt = 1;
+    printf("Comprimiendo con %d hilos...\n", nt);
+
+    // Un hilo recorre la carpeta y llena la cola mientras los demás comprimen
+    pthread_t scan_thread;
+    int scanning = pthread_create(&scan_thread, NULL, scanner, job) == 0;
+    if (!scanning) {
+        // Todavía no hay nadie sacando de la cola: esperar a que se vacíe no terminaría nunca
+        job->scan_inline = 1;
+        scanner(job);
+    }
+    run_threads(worker, job, nt);
+    if (scanning) pthread_join(scan_thread, NULL);
+
+    // Lo que haya quedado en la cola (solo si hubo error)
+    for (size_t i = 0; i < job->queue_len; i++) {
+        if (job->queue[i]->split) free_split(job->queue[i]->split);
+        else free(job->queue[i]->path);
+        free(job->queue[i]);
+    }
+    free(job->queue);
+
+    error = job->error;
+    count = index.files.count;
+    files = count - job->tables;
+    if (!error && files == 0) { printf("Carpeta vacía\n"); error = 1; }
+
+    // Cantidad de entradas, índice central y pie al final, para encontrar cualquier entrada sin recorrer el archivo
+    unsigned int count32 = count;
+    memcpy(head + 8, &count32, 4);
+    if (!error && (pwrite_all(job->fd, head, sizeof(head), 0) != 0
+                   || write_index(job->fd, job->off, &index) != 0)) { perror("write"); error = 1; }
+    if (close(job->fd) != 0) { perror("close"); error = 1; }
+    if (error) unlink(write_path);
+    else if (temp_path && rename(temp_path, output_path) != 0) { perror("rename"); unlink(temp_path); error = 1; }
+
+done:
+    if (!error && job->old) printf("%zu archivos sin cambios copiados, %zu comprimidos\n", job->reused, files - job->reused);
+    if (!error && job->duplicates) printf("%zu archivos duplicados guardados como referencia\n", job->duplicates);
+    dedup_free(&job->dedup);
+    huffman_shared_free(job->shared);
+    if (job->old_fd >= 0) close(job->old_fd);
+    free(job->old_paths.slots);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->not_empty);
+    pthread_cond_destroy(&job->not_full);
+    free(job);
+    free(temp_path);
+    har_index_free(&index);
+    har_index_free(&old);
+    if (error) return -1;
+    printf("OK: %zu archivos -> %s\n", files, output_path);
+    return 0;
+}
+
+int compress_directory(const char *input_path, const char *output_path, int num_threads) {
+    return compress_directory_flags(input_path, output_path, num_threads, 0);
+}
+
 int is_har_archive(const char *path) {
     int fd = open(path, O_RDONLY);
     if (fd < 0) return 0;
@@ -123,70 +1197,271 @@ int is_har_archive(const char *path) {
     return r;
 }
 
-static void mkdirs(const char *path) {
-    char tmp[1024];
-    strncpy(tmp, path, sizeof(tmp)-1);
-    tmp[sizeof(tmp)-1] = 0;
-    for (char *p = tmp; *p; p++) {
-        if (*p == '/' && p != tmp) {
-            *p = 0;
-            mkdir(tmp, 0755);
-            *p = '/';
+// Lee el índice central del final del .har. Devuelve 0 si lo pudo leer, 1 si el .har
+// no tiene índice (formato antiguo) y -1 si el índice está dañado.
+static int read_index(int fd, off_t file_size, HarIndex *h) {
+    unsigned char foot[INDEX_FOOTER];
+    uint64_t index_off, index_len;
+    if (file_size < 12 + INDEX_FOOTER || pread_all(fd, foot, INDEX_FOOTER, file_size - INDEX_FOOTER) != 0) return 1;
+    size_t record;
+    if (memcmp(foot + 16, MAGIC_INDEX, 8) == 0) record = INDEX_RECORD;
+    else if (memcmp(foot + 16, MAGIC_INDEX_V2, 8) == 0) record = INDEX_RECORD_V2;
+    else if (memcmp(foot + 16, MAGIC_INDEX_V1, 8) == 0) record = INDEX_RECORD_V1;
+    else return 1;
+    memcpy(&index_off, foot, 8);
+    memcpy(&index_len, foot + 8, 8);
+    if (index_off < 12 || index_len > (uint64_t)file_size
+        || index_off + index_len != (uint64_t)(file_size - INDEX_FOOTER)) return -1;
+
+    unsigned char *buf = malloc(index_len ? index_len : 1);
+    if (!buf) { perror("malloc"); return -1; }
+    if (pread_all(fd, buf, index_len, index_off) != 0) { free(buf); return -1; }
+
+    size_t p = 0;
+    while (p < index_len) {
+        unsigned short plen;
+        if (index_len - p < 3) break;
+        int type = buf[p];
+        memcpy(&plen, buf + p + 1, 2);
+        if (index_len - p - 3 < (size_t)plen + record) break;
+        const char *path = (const char*)buf + p + 3;
+        p += 3 + plen;
+        uint64_t pos, comp, orig;
+        int64_t mtime;
+        int32_t nsec = 0;     // los índices anteriores no tienen todos los campos
+        uint64_t hash = 0;
+        memcpy(&pos, buf + p, 8);
+        memcpy(&comp, buf + p + 8, 8);
+        memcpy(&orig, buf + p + 16, 8);
+        memcpy(&mtime, buf + p + 24, 8);
+        if (record >= INDEX_RECORD_V2) memcpy(&nsec, buf + p + 32, 4);
+        if (record >= INDEX_RECORD) memcpy(&hash, buf + p + 36, 8);
+        p += record;
+        mtime = mtime * NSEC_PER_SEC + nsec;
+        if (pos > index_off || comp > index_off - pos) break;
+        if (har_index_add(h, path, plen, orig, mtime, pos, comp, type, hash) != 0) break;
+    }
+    free(buf);
+    return p == index_len ? 0 : -1;
+}
+
+// Todas las entradas del .har: desde el índice si lo tiene; si no, leyendo los encabezados
+// uno por uno y saltando los payloads. Devuelve 0 si todo bien, -1 si el .har está dañado
+// (en ese caso h tiene las entradas que sí se pudieron leer).
+static int load_entries(int fd, off_t file_size, HarIndex *h) {
+    int r = read_index(fd, file_size, h);
+    if (r <= 0) return r;
+
+    char m[8];
+    unsigned int count;
+    if (pread_all(fd, m, 8, 0) != 0 || memcmp(m, MAGIC, 8) != 0 || pread_all(fd, &count, 4, 8) != 0) return -1;
+    off_t off = 12;
+    char *path = malloc(FILELIST_MAX_PATH);
+    if (!path) { perror("malloc"); return -1; }
+    int bad = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned char hdr[3];
+        unsigned short plen;
+        unsigned long size;
+        if (pread_all(fd, hdr, 3, off) != 0) { bad = 1; break; }
+        memcpy(&plen, hdr + 1, 2);
+        if (pread_all(fd, path, plen, off + 3) != 0 || pread_all(fd, &size, 8, off + 3 + plen) != 0) { bad = 1; break; }
+        off_t pos = off + 3 + plen + 8;
+        if (hdr[0] & ENTRY_REF) {
+            // Duplicado: size es la posición del payload, y después viene su tamaño
+            uint64_t target = size, comp;
+            if (pread_all(fd, &comp, 8, pos) != 0 || target > (uint64_t)off || comp > (uint64_t)off - target) { bad = 1; break; }
+            if (har_index_add(h, path, plen, ORIG_UNKNOWN, 0, target, comp, hdr[0], 0) != 0) { bad = 1; break; }
+            off = pos + 8;
+            continue;
+        }
+        if (size > (unsigned long)file_size || pos + (off_t)size > file_size) { bad = 1; break; }
+        if (har_index_add(h, path, plen, ORIG_UNKNOWN, 0, pos, size, hdr[0], 0) != 0) { bad = 1; break; }
+        off = pos + (off_t)size;
+    }
+    free(path);
+    return bad ? -1 : 0;
+}
+
+// Entrada guardada tal cual: se copia del .har a la salida sin pasar por la memoria del
+// proceso (copy_file_range a un archivo, sendfile a stdout, que puede ser un pipe)
+static int extract_raw(int fd, const HarSlot *e, const char *output_path) {
+    int to_stdout = strcmp(output_path, "-") == 0;
+    int out = to_stdout ? STDOUT_FILENO : open(output_path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
+    if (out < 0) { perror("open output"); return -1; }
+    int r = 0;
+    if (to_stdout) {
+        off_t off = e->off;
+        size_t len = e->comp;
+        while (r == 0 && len > 0) {
+            ssize_t n = sendfile(out, fd, &off, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) break;   // p. ej. stdout con O_APPEND
+            if (n <= 0) r = -1;
+            else len -= (size_t)n;
+        }
+        // Si sendfile no sirve para esta salida, el resto se copia con pread/write
+        char *buf = r == 0 && len > 0 ? malloc(1 << 20) : NULL;
+        if (r == 0 && len > 0 && !buf) r = -1;
+        while (r == 0 && len > 0) {
+            size_t n = len < (1 << 20) ? len : (1 << 20);
+            r = pread_all(fd, buf, n, off) == 0 && write_all(out, buf, n) == 0 ? 0 : -1;
+            off += n; len -= n;
+        }
+        free(buf);
+    } else {
+        r = copy_range(fd, e->off, out, 0, e->comp);
+    }
+    if (r != 0) perror("write");
+    if (!to_stdout && close(out) != 0) { perror("close"); r = -1; }
+    return r;
+}
+
+// Extrae una entrada según su formato. El payload se lee del .har mapeado (map) o, si no
+// está mapeado, con pread. shared es la tabla del modo sólido (o NULL si el .har no tiene).
+static int extract_entry(int fd, const unsigned char *map, const HuffShared *shared,
+                         const HarSlot *e, const char *output_path) {
+    int codec = ENTRY_CODEC(e->type);
+    if (codec == ENTRY_RAW) return extract_raw(fd, e, output_path);
+    if (codec == ENTRY_SHARED && !shared) { fprintf(stderr, "Error: falta la tabla compartida del .har\n"); return -1; }
+    if (codec != ENTRY_HUFF && codec != ENTRY_SHARED) { fprintf(stderr, "Error: tipo de entrada desconocido\n"); return -1; }
+
+    const unsigned char *src = map ? map + e->off : NULL;
+    unsigned char *buf = NULL;
+    if (!src) {
+        buf = malloc(e->comp ? e->comp : 1);
+        if (!buf) { perror("malloc"); return -1; }
+        if (pread_all(fd, buf, e->comp, e->off) != 0) { perror("read"); free(buf); return -1; }
+        src = buf;
+    }
+    int r = codec == ENTRY_HUFF ? decompress_memory(src, e->comp, output_path)
+                                : huffman_shared_decode(shared, src, e->comp, output_path);
+    free(buf);
+    return r;
+}
+
+// Estado de una extracción, igual que CompressJob: uno por llamada
+typedef struct {
+    int fd;                      // .har abierto (para pread si no se pudo mapear)
+    const unsigned char *map;    // .har mapeado en memoria, o NULL
+    const char *out_dir;
+    const HarIndex *index;
+    const HuffShared *shared;    // tabla del modo sólido, o NULL
+    size_t next;                 // siguiente entrada por extraer (con el candado)
+    int error;
+    pthread_mutex_t lock;
+} ExtractJob;
+
+// Cada hilo toma la siguiente entrada y la descomprime directo desde su posición en el .har
+static void* extract_worker(void *arg) {
+    ExtractJob *job = arg;
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        if (job->next >= job->index->files.count) { pthread_mutex_unlock(&job->lock); break; }
+        size_t idx = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        const char *path = filelist_path(&job->index->files, idx);
+        const HarSlot *e = &job->index->slots[idx];
+        if (e->type == ENTRY_TABLE) continue;
+        char *out = path_join(job->out_dir, path);
+        int r = -1;
+        if (out) {
+            // Crear directorios intermedios. Si otro hilo ya creó alguno, mkdir falla con EEXIST y seguimos.
+            mkdirs_for_file(out);
+            r = extract_entry(job->fd, job->map, job->shared, e, out);
+            free(out);
+        }
+        if (r != 0) {
+            fprintf(stderr, "Error extrayendo %s\n", path);
+            pthread_mutex_lock(&job->lock); job->error = 1; pthread_mutex_unlock(&job->lock);
         }
     }
-    mkdir(tmp, 0755);  // crear el último directorio también
+    return NULL;
 }
 
-int decompress_directory(const char *input_path, const char *output_path) {
+int decompress_directory(const char *input_path, const char *output_path, int num_threads) {
     int fd = open(input_path, O_RDONLY);
     if (fd < 0) return -1;
+    struct stat st;
     char m[8];
     unsigned int count;
-    if (read(fd, m, 8) != 8 || memcmp(m, MAGIC, 8) != 0 || read(fd, &count, 4) != 4) {
+    if (fstat(fd, &st) != 0 || read(fd, m, 8) != 8 || memcmp(m, MAGIC, 8) != 0 || read(fd, &count, 4) != 4) {
         close(fd); return -1;
     }
+
+    // 1. Leer todas las entradas una sola vez (del índice, o de los encabezados si no hay)
+    HarIndex index;
+    har_index_init(&index);
+    int bad = load_entries(fd, st.st_size, &index) != 0;
+    if (bad) fprintf(stderr, "Error: .har dañado, se extraen %zu de %u archivos\n", index.files.count, count);
+    HuffShared *shared;
+    if (load_shared(fd, &index, &shared) != 0) bad = 1;
+    size_t files = 0;
+    for (size_t i = 0; i < index.files.count; i++) files += index.slots[i].type != ENTRY_TABLE;
+
     mkdir(output_path, 0755);
-    printf("Extrayendo %u archivos...\n", count);
-    
-    char buf[8192];
-    for (unsigned int i = 0; i < count; i++) {
-        unsigned char type;
-        unsigned short plen;
-        unsigned long size;
-        if (read(fd, &type, 1) != 1 || read(fd, &plen, 2) != 2) break;
-        
-        char path[1024];
-        if (read(fd, path, plen) != plen) break;
-        path[plen] = 0;
-        if (read(fd, &size, 8) != 8) break;
-        
-        char out[2048], tmp[64];
-        sprintf(out, "%s/%s", output_path, path);
-        sprintf(tmp, ".ext_%u.huf", i);
-        
-        // Crear directorios intermedios incluyendo output_path
-        char dir_path[2048];
-        strncpy(dir_path, out, sizeof(dir_path)-1);
-        dir_path[sizeof(dir_path)-1] = 0;
-        char *slash = strrchr(dir_path, '/');
-        if (slash) {
-            *slash = 0;
-            mkdirs(dir_path);
-        }
-        
-        int tf = open(tmp, O_CREAT|O_TRUNC|O_WRONLY, 0644);
-        unsigned long left = size;
-        while (left > 0) {
-            size_t n = left > sizeof(buf) ? sizeof(buf) : left;
-            if (read(fd, buf, n) != (ssize_t)n) break;
-            write(tf, buf, n);
-            left -= n;
-        }
-        close(tf);
-        decompress_file(tmp, out);
-        unlink(tmp);
-    }
+    printf("Extrayendo %zu archivos con %d hilos...\n", files, num_threads);
+
+    // 2. Mapear el .har para que los hilos lean los payloads sin copiarlos; si no se puede, pread
+    ExtractJob job = { fd, NULL, output_path, &index, shared, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+    void *map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) job.map = map;
+
+    run_threads(extract_worker, &job, num_threads);
+
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+    pthread_mutex_destroy(&job.lock);
+    huffman_shared_free(shared);
+    har_index_free(&index);
     close(fd);
+    if (bad || job.error) return -1;
     printf("OK: %s\n", output_path);
     return 0;
 }
+
+int extract_file(const char *archive_path, const char *path, const char *output_path) {
+    int fd = open(archive_path, O_RDONLY);
+    if (fd < 0) { perror("open"); return -1; }
+    struct stat st;
+    HarIndex index;
+    har_index_init(&index);
+    HuffShared *shared = NULL;
+    int r = -1;
+    if (fstat(fd, &st) == 0 && load_entries(fd, st.st_size, &index) == 0) {
+        size_t i = 0;
+        while (i < index.files.count && (index.slots[i].type == ENTRY_TABLE
+                                         || strcmp(filelist_path(&index.files, i), path) != 0)) i++;
+        if (i == index.files.count) fprintf(stderr, "No existe %s en %s\n", path, archive_path);
+        else if (load_shared(fd, &index, &shared) == 0) r = extract_entry(fd, NULL, shared, &index.slots[i], output_path);
+    } else {
+        fprintf(stderr, "Error: .har dañado\n");
+    }
+    huffman_shared_free(shared);
+    har_index_free(&index);
+    close(fd);
+    return r;
+}
+
+int list_archive(const char *archive_path) {
+    int fd = open(archive_path, O_RDONLY);
+    if (fd < 0) { perror("open"); return -1; }
+    struct stat st;
+    HarIndex index;
+    har_index_init(&index);
+    int r = fstat(fd, &st) == 0 ? load_entries(fd, st.st_size, &index) : -1;
+    printf("%12s %12s  %s\n", "original", "comprimido", "ruta");
+    for (size_t i = 0; i < index.files.count; i++) {
+        const FileEntry *f = &index.files.items[i];
+        if (index.slots[i].type == ENTRY_TABLE) continue;
+        if (f->size != ORIG_UNKNOWN) printf("%12llu ", (unsigned long long)f->size);
+        else printf("%12s ", "?");
+        if (index.slots[i].type & ENTRY_REF) printf("%12s ", "duplicado");
+        else printf("%12llu ", (unsigned long long)index.slots[i].comp);
+        printf(" %s\n", filelist_path(&index.files, i));
+    }
+    if (r != 0) fprintf(stderr, "Error: .har dañado\n");
+    har_index_free(&index);
+    close(fd);
+    return r;
+}
@@ -1,4 +1,5 @@
 // archiver.h - Soporte para comprimir/descomprimir carpetas con hilos
+// Cada llamada tiene su propio estado (sin variables globales): se pueden usar desde varios hilos a la vez.
 
 // Comprime una carpeta completa usando hilos:
 // - input_path: ruta de la carpeta a comprimir
@@ -7,11 +8,32 @@
 // Devuelve 0 si OK, -1 si error
 int compress_directory(const char *input_path, const char *output_path, int num_threads);
 
+// Opciones para compress_directory_flags
+#define HAR_UPDATE 1   // si output_path ya es un .har, copiar tal cual las entradas que no cambiaron
+                       // (misma ruta, tamaño y mtime) y comprimir solo las nuevas o modificadas
+#define HAR_SOLID 2    // una sola tabla de códigos para todos los archivos chicos, guardada una vez
+                       // en el .har (cada archivo lleva solo sus bits); cuesta una pasada más de lectura
+                       // Con HAR_UPDATE sigue con la tabla del .har anterior, si tiene una, para poder
+                       // copiar también las entradas que la usan
+
+// Igual que compress_directory, con las opciones HAR_* combinadas con |
+int compress_directory_flags(const char *input_path, const char *output_path, int num_threads, int flags);
+
 // Descomprime un archivo .har a una carpeta:
 // - input_path: archivo .har a descomprimir
 // - output_path: carpeta destino donde se extraerán los archivos
+// - num_threads: cantidad de hilos para extraer archivos en paralelo
+// Devuelve 0 si OK, -1 si error
+int decompress_directory(const char *input_path, const char *output_path, int num_threads);
+
+// Extrae un solo archivo del .har sin recorrerlo: busca 'path' (ruta relativa, tal como la
+// muestra list_archive) en el índice del final y descomprime solo esa entrada en output_path.
+// Devuelve 0 si OK, -1 si no existe o hubo error
+int extract_file(const char *archive_path, const char *path, const char *output_path);
+
+// Muestra las entradas del .har (tamaño original, comprimido y ruta) leyendo solo el índice
 // Devuelve 0 si OK, -1 si error
-int decompress_directory(const char *input_path, const char *output_path);
+int list_archive(const char *archive_path);
 
 // Verifica si un archivo es un .har válido
 // Devuelve 1 si es .har, 0 si no lo es, -1 si error
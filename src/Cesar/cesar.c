@@ -5,26 +5,140 @@
 #include <stdio.h> //Solo para perror y printf
 #include <stdlib.h>
 #include <pthread.h>
-#include <dirent.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <sys/mman.h> // mmap, madvise
+#include <stdint.h>
+#include "../FileList/filelist.h"
 
-// Funcion que aplica la transformacion César a un buffer
-static void cesar_transform_buffer(unsigned char *buf, ssize_t len, unsigned char key, int decrypt){
-    for (ssize_t i = 0; i < len; i++){
-        if (!decrypt){
-            // Se usa & 0xFF para asegurar que el resultado se mantenga en el rango de un byte (0-255.
-            // Es equivalente a hacer un modulo 256 pero más eficiente ya que no realiza divisiones.
-            buf[i] = (unsigned char)((buf[i] + key) & 0xFF);
+// La transformación César es sumar add a cada byte módulo 256: para encriptar add = key y para
+// desencriptar add = -key (restar key es sumar 256 - key), así hay un solo camino y sin ifs.
+// La suma se hace con vectores de GCC del ancho de los registros de la CPU: 64 bytes con
+// AVX-512, 32 con AVX2 y 16 en cualquier otra (SSE2 en x86-64, NEON en ARM). Cuál se usa se
+// decide en cada llamada con CPUID (__builtin_cpu_supports, que solo lee lo que ya detectó
+// al arrancar), así la transformación va a la velocidad de la memoria y no de a un byte por ciclo.
+// Cada variante procesa los vectores completos y devuelve cuántos bytes hizo; el resto va de a uno.
+// aligned(1) y may_alias: los vectores se leen y escriben en cualquier posición de un buffer de bytes.
+#ifdef __GNUC__
+typedef unsigned char cesar_vec16 __attribute__((vector_size(16), aligned(1), may_alias));
+
+static size_t cesar_add_vec16(const unsigned char *src, unsigned char *dst, size_t len, unsigned char add){
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16){
+        // Cada byte se suma por separado: el acarreo no pasa al siguiente (módulo 256)
+        *(cesar_vec16 *)(dst + i) = *(const cesar_vec16 *)(src + i) + add;
+    }
+    return i;
+}
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CESAR_X86_DISPATCH
+typedef unsigned char cesar_vec32 __attribute__((vector_size(32), aligned(1), may_alias));
+typedef unsigned char cesar_vec64 __attribute__((vector_size(64), aligned(1), may_alias));
+
+__attribute__((target("avx2")))
+static size_t cesar_add_avx2(const unsigned char *src, unsigned char *dst, size_t len, unsigned char add){
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32){
+        *(cesar_vec32 *)(dst + i) = *(const cesar_vec32 *)(src + i) + add;
+    }
+    return i;
+}
+
+__attribute__((target("avx512bw")))
+static size_t cesar_add_avx512(const unsigned char *src, unsigned char *dst, size_t len, unsigned char add){
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64){
+        *(cesar_vec64 *)(dst + i) = *(const cesar_vec64 *)(src + i) + add;
+    }
+    return i;
+}
+#endif
+
+// Aplica la transformación de src a dst (pueden ser el mismo buffer)
+static void cesar_transform_buffer(const unsigned char *src, unsigned char *dst, size_t len, unsigned char add){
+    size_t i = 0;
+#if defined(CESAR_X86_DISPATCH)
+    if (__builtin_cpu_supports("avx512bw")){
+        i = cesar_add_avx512(src, dst, len, add);
+    }
+    else if (__builtin_cpu_supports("avx2")){
+        i = cesar_add_avx2(src, dst, len, add);
+    }
+    else{
+        i = cesar_add_vec16(src, dst, len, add);
+    }
+#elif defined(__GNUC__)
+    i = cesar_add_vec16(src, dst, len, add);
+#endif
+    for (; i < len; i++){
+        dst[i] = (unsigned char)(src[i] + add);
+    }
+}
+
+// Tamaño del buffer de salida: se escribe en bloques grandes para hacer pocas llamadas a write()
+#define CESAR_BUF_SIZE (1 << 20)
+
+// Archivo grande con varios hilos: cada byte se transforma sin depender de los demás y la salida
+// mide lo mismo que la entrada, así que el archivo se reparte en pedazos de CESAR_BUF_SIZE y
+// cada hilo transforma el siguiente pedazo libre desde el mapa y lo escribe en la misma posición.
+typedef struct {
+    const unsigned char *map;
+    size_t size;
+    int fd_out;
+    unsigned char add;
+    size_t next;            // siguiente pedazo por transformar (con el candado)
+    int error;
+    pthread_mutex_t lock;
+} CesarRangeJob;
+
+static void* cesar_range_worker(void *arg){
+    CesarRangeJob *job = arg;
+    unsigned char *buf = malloc(CESAR_BUF_SIZE);
+    if (!buf){
+        perror("malloc");
+        pthread_mutex_lock(&job->lock);
+        job->error = 1;
+        pthread_mutex_unlock(&job->lock);
+        return NULL;
+    }
+    while (1){
+        pthread_mutex_lock(&job->lock);
+        size_t off = job->next * (size_t)CESAR_BUF_SIZE;
+        int stop = job->error || off >= job->size;
+        if (!stop){
+            job->next++;
         }
-        else{
-            buf[i] = (unsigned char)((buf[i] - key) & 0xFF);
+        pthread_mutex_unlock(&job->lock);
+        if (stop){
+            break;
+        }
+
+        size_t n = job->size - off < CESAR_BUF_SIZE ? job->size - off : CESAR_BUF_SIZE;
+        cesar_transform_buffer(job->map + off, buf, n, job->add);
+        if (pwrite_all(job->fd_out, buf, n, (off_t)off) != 0){
+            perror("write output");
+            pthread_mutex_lock(&job->lock);
+            job->error = 1;
+            pthread_mutex_unlock(&job->lock);
+            break;
         }
     }
+    free(buf);
+    return NULL;
 }
 
+static int cesar_do_parallel(const unsigned char *map, size_t size, int fd_out, unsigned char add, int num_threads){
+    CesarRangeJob job = { map, size, fd_out, add, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+    run_threads(cesar_range_worker, &job, num_threads);
+    pthread_mutex_destroy(&job.lock);
+    return job.error ? -1 : 0;
+}
 
-static int cesar_do(const char *input_path, const char *output_path, unsigned char key, int decrypt){
+// Aplica la transformación (sumar add a cada byte) a todo el archivo, con num_threads hilos
+// si es un archivo regular de varios pedazos
+static int cesar_do(const char *input_path, const char *output_path, unsigned char add, int num_threads){
     int fd_in = open(input_path, O_RDONLY);
     if (fd_in < 0){
         perror("open input");
@@ -38,154 +152,279 @@ static int cesar_do(const char *input_path, const char *output_path, unsigned ch
         return -1;
     }
 
-    unsigned char buf[4096];
-    while (1){
-        ssize_t r = read(fd_in, buf, sizeof(buf));
-        if (r < 0){
-            perror("read input");
-            close(fd_in);
-            close(fd_out);
-            return -1;
-        }
+    unsigned char *buf = malloc(CESAR_BUF_SIZE);
+    if (!buf){
+        perror("malloc");
+        close(fd_in);
+        close(fd_out);
+        return -1;
+    }
 
-        if (r == 0){
-            break;
+    // Si la entrada es un archivo regular se mapea en memoria: la transformación lee directo
+    // de las páginas del caché y escribe en buf, sin la copia intermedia de read().
+    struct stat st;
+    unsigned char *map = NULL;
+    size_t size = 0;
+    if (fstat(fd_in, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        size = (size_t)st.st_size;
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd_in, 0);
+        if (map == MAP_FAILED){
+            map = NULL;
         }
+        else{
+            madvise(map, size, num_threads > 1 ? MADV_WILLNEED : MADV_SEQUENTIAL);
+        }
+    }
 
-        cesar_transform_buffer(buf, r, key, decrypt);
+    // Los pedazos se escriben con pwrite en cualquier orden: solo si la salida es un archivo
+    // regular. Hacia un pipe, una fifo o una terminal se escribe en orden.
+    struct stat st_out;
+    int out_regular = fstat(fd_out, &st_out) == 0 && S_ISREG(st_out.st_mode);
 
-        // Asegurarse de escribir todos los bytes leídos, si en una llamada a write() falla en escribir todos los bytes se suma a la variable written la cantidad de lineas que logro escribir y se intenta escribir el resto hasta completar r bytes (bytes leidos)
-        ssize_t written = 0;
-        while (written < r){
-            ssize_t w = write(fd_out, buf + written, r - written);
-            if (w < 0){
+    int status = 0;
+    if (map && out_regular && num_threads > 1 && size > 2 * (size_t)CESAR_BUF_SIZE){
+        status = cesar_do_parallel(map, size, fd_out, add, num_threads);
+        munmap(map, size);
+    }
+    else if (map){
+        for (size_t off = 0; off < size; off += CESAR_BUF_SIZE){
+            ssize_t n = size - off < CESAR_BUF_SIZE ? (ssize_t)(size - off) : CESAR_BUF_SIZE;
+            cesar_transform_buffer(map + off, buf, n, add);
+            if (write_all(fd_out, buf, n) != 0){
+                perror("write output");
+                status = -1;
+                break;
+            }
+        }
+        munmap(map, size);
+    }
+    else{
+        // Entrada que no se puede mapear (pipe, dispositivo...): lectura normal por bloques
+        while (1){
+            ssize_t r = read(fd_in, buf, CESAR_BUF_SIZE);
+            if (r < 0){
                 if (errno == EINTR){
                     continue;
                 }
+                perror("read input");
+                status = -1;
+                break;
+            }
+
+            if (r == 0){
+                break;
+            }
+
+            cesar_transform_buffer(buf, buf, r, add);
+
+            if (write_all(fd_out, buf, r) != 0){
                 perror("write output");
-                close(fd_in);
-                close(fd_out);
-                return -1;
+                status = -1;
+                break;
             }
-            written += w;
         }
     }
-    
+
+    free(buf);
     close(fd_in);
     close(fd_out);
-    return 0;
+    return status;
+}
+
+void cesar_encrypt_buffer(const unsigned char *src, unsigned char *dst, size_t len, unsigned char key){
+    cesar_transform_buffer(src, dst, len, key);
+}
+
+void cesar_decrypt_buffer(const unsigned char *src, unsigned char *dst, size_t len, unsigned char key){
+    cesar_transform_buffer(src, dst, len, (unsigned char)-key);
 }
 
 int cesar_encrypt_file(const char *input_path, const char *output_path, unsigned char key){
-    return cesar_do(input_path, output_path, key, 0);
+    return cesar_do(input_path, output_path, key, 1);
 }
 
 int cesar_decrypt_file(const char *input_path, const char *output_path, unsigned char key){
-    return cesar_do(input_path, output_path, key, 1);
+    return cesar_do(input_path, output_path, (unsigned char)-key, 1);
+}
+
+int cesar_encrypt_file_mt(const char *input_path, const char *output_path, unsigned char key, int num_threads){
+    return cesar_do(input_path, output_path, key, num_threads);
+}
+
+int cesar_decrypt_file_mt(const char *input_path, const char *output_path, unsigned char key, int num_threads){
+    return cesar_do(input_path, output_path, (unsigned char)-key, num_threads);
 }
 
-#define MAX_FILES_CESAR 512
 static const char MAGIC_CSAR[8] = "CSAR1000";
 
-typedef struct { char path[1024]; char temp[64]; long size; } CesarFile;
-static CesarFile cesar_files[MAX_FILES_CESAR];
-static int cesar_file_count = 0;
-static int cesar_next_job = 0;
-static unsigned char cesar_key_global = 0;
-static pthread_mutex_t cesar_lock = PTHREAD_MUTEX_INITIALIZER;
+// Estado de una encriptación o desencriptación de carpeta: uno por llamada, sin variables globales.
+// La salida mide lo mismo que la entrada, así que la posición de cada archivo dentro del .csar
+// se conoce antes de arrancar los hilos: offsets[i] es donde empiezan los datos del archivo i.
+// Los hilos toman el siguiente pedazo de CESAR_BUF_SIZE (next_file, next_chunk), lo leen de un
+// lado, lo transforman y lo escriben en su lugar del otro, así un archivo grande también se
+// reparte entre todos. Al encriptar se lee del archivo de base y se escribe en el .csar; al
+// extraer (extract = 1) al revés.
+typedef struct {
+    const char *base;       // carpeta de entrada (encriptar) o de salida (extraer)
+    FileList files;
+    uint64_t *offsets;
+    int fd_archive;
+    int extract;
+    size_t next_file;       // siguiente pedazo por transformar (con el candado)
+    uint64_t next_chunk;
+    unsigned char add;
+    int error;
+    pthread_mutex_t lock;
+} CesarJob;
+
+static void cesar_job_fail(CesarJob *job){
+    pthread_mutex_lock(&job->lock);
+    job->error = 1;
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Los archivos de más de un pedazo los escriben varios hilos a la vez, así que se crean con su
+// tamaño final antes de arrancar; los de un solo pedazo los crea el hilo que los toma.
+static int cesar_multi_chunk(uint64_t size){
+    return size > CESAR_BUF_SIZE;
+}
+
+// Abre el archivo idx del lado de la carpeta: para leer al encriptar, para escribir al extraer
+static int cesar_open_member(CesarJob *job, size_t idx){
+    char *full = path_join(job->base, filelist_path(&job->files, idx));
+    if (!full){
+        perror("malloc");
+        return -1;
+    }
+    int fd;
+    if (!job->extract){
+        fd = open(full, O_RDONLY);
+    }
+    else if (cesar_multi_chunk(job->files.items[idx].size)){
+        fd = open(full, O_WRONLY);
+    }
+    else{
+        mkdirs_for_file(full);
+        fd = open(full, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0){
+        perror(full);
+    }
+    free(full);
+    return fd;
+}
 
-// Worker de cada hilo para encriptar
+// Worker de cada hilo. El archivo abierto se guarda mientras los pedazos que tocan sean del
+// mismo, así un archivo grande se abre una vez por hilo.
 static void* cesar_worker(void *arg) {
-    char *base = (char*)arg;
+    CesarJob *job = arg;
+    unsigned char *buf = malloc(CESAR_BUF_SIZE);
+    if (!buf) { perror("malloc"); cesar_job_fail(job); return NULL; }
+    size_t open_idx = (size_t)-1;
+    int fd_member = -1;
     while (1) {
-        pthread_mutex_lock(&cesar_lock);
-        if (cesar_next_job >= cesar_file_count) { pthread_mutex_unlock(&cesar_lock); break; }
-        int idx = cesar_next_job++;
-        pthread_mutex_unlock(&cesar_lock);
-        
-        sprintf(cesar_files[idx].temp, ".ctmp_%d.ces", idx);
-        char full[2048];
-        sprintf(full, "%s/%s", base, cesar_files[idx].path);
-        cesar_encrypt_file(full, cesar_files[idx].temp, cesar_key_global);
-        struct stat st;
-        if (stat(cesar_files[idx].temp, &st) == 0) cesar_files[idx].size = st.st_size;
+        pthread_mutex_lock(&job->lock);
+        // Al encriptar, los archivos vacíos no tienen pedazos: solo su encabezado, que ya está
+        // escrito. Al extraer igual hay que crearlos, así que cuentan como un pedazo de 0 bytes.
+        if (!job->extract)
+            while (job->next_file < job->files.count && job->files.items[job->next_file].size == 0) job->next_file++;
+        int stop = job->error || job->next_file >= job->files.count;
+        size_t idx = job->next_file;
+        uint64_t chunk = job->next_chunk;
+        if (!stop) {
+            if ((chunk + 1) * CESAR_BUF_SIZE >= job->files.items[idx].size) { job->next_file++; job->next_chunk = 0; }
+            else job->next_chunk++;
+        }
+        pthread_mutex_unlock(&job->lock);
+        if (stop) break;
+
+        if (idx != open_idx) {
+            if (fd_member >= 0) close(fd_member);
+            fd_member = cesar_open_member(job, idx);
+            if (fd_member < 0) { cesar_job_fail(job); break; }
+            open_idx = idx;
+        }
+
+        uint64_t size = job->files.items[idx].size;
+        uint64_t off = chunk * CESAR_BUF_SIZE;
+        size_t n = size - off < CESAR_BUF_SIZE ? (size_t)(size - off) : CESAR_BUF_SIZE;
+        int fd_from = job->extract ? job->fd_archive : fd_member;
+        int fd_to = job->extract ? fd_member : job->fd_archive;
+        off_t from = (off_t)(job->extract ? job->offsets[idx] + off : off);
+        off_t to = (off_t)(job->extract ? off : job->offsets[idx] + off);
+        // Al encriptar, si el archivo se achicó desde que se listó ya no llena su lugar reservado
+        if (pread_all(fd_from, buf, n, from) != 0) {
+            fprintf(stderr, "Error leyendo %s (¿cambió durante la operación?)\n", filelist_path(&job->files, idx));
+            cesar_job_fail(job);
+            break;
+        }
+        cesar_transform_buffer(buf, buf, n, job->add);
+        if (pwrite_all(fd_to, buf, n, to) != 0) {
+            perror("write output");
+            cesar_job_fail(job);
+            break;
+        }
     }
+    if (fd_member >= 0) close(fd_member);
+    free(buf);
     return NULL;
 }
 
-// Escaneo recursivo de carpetas
-static void cesar_scan_recursive(const char *base, const char *rel);
+// Escribe el encabezado del .csar y el de cada entrada (ruta y tamaño) en su lugar, y llena
+// job->offsets. Los datos los escriben después los hilos en los huecos que quedan.
+static int cesar_write_layout(CesarJob *job) {
+    unsigned char head[13];
+    unsigned int count = job->files.count;
+    memcpy(head, MAGIC_CSAR, 8);
+    head[8] = job->add;
+    memcpy(head + 9, &count, 4);
+    if (pwrite_all(job->fd_archive, head, sizeof(head), 0) != 0) return -1;
 
-static void cesar_scan(const char *dir) {
-    cesar_scan_recursive(dir, "");
-}
-
-static void cesar_scan_recursive(const char *base, const char *rel) {
-    char path[2048];
-    sprintf(path, "%s%s%s", base, rel[0] ? "/" : "", rel);
-    
-    DIR *d = opendir(path);
-    if (!d) return;
-    struct dirent *e;
-    while ((e = readdir(d))) {
-        if (e->d_name[0] == '.' || cesar_file_count >= MAX_FILES_CESAR) continue;
-        
-        char full[2048], relpath[1024];
-        sprintf(full, "%s/%s", path, e->d_name);
-        sprintf(relpath, "%s%s%s", rel, rel[0] ? "/" : "", e->d_name);
-        
-        struct stat st;
-        if (stat(full, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                cesar_scan_recursive(base, relpath);
-            } else if (S_ISREG(st.st_mode)) {
-                strncpy(cesar_files[cesar_file_count].path, relpath, sizeof(cesar_files[0].path)-1);
-                cesar_files[cesar_file_count].path[sizeof(cesar_files[0].path)-1] = 0;
-                cesar_files[cesar_file_count].size = st.st_size;
-                cesar_file_count++;
-            }
-        }
+    unsigned char *entry = malloc(2 + FILELIST_MAX_PATH + 8);
+    if (!entry) { perror("malloc"); return -1; }
+    uint64_t pos = sizeof(head);
+    for (size_t i = 0; i < job->files.count; i++) {
+        const char *path = filelist_path(&job->files, i);
+        unsigned short plen = strlen(path);
+        uint64_t size = job->files.items[i].size;
+        memcpy(entry, &plen, 2);
+        memcpy(entry + 2, path, plen);
+        memcpy(entry + 2 + plen, &size, 8);
+        if (pwrite_all(job->fd_archive, entry, 2 + plen + 8, (off_t)pos) != 0) { free(entry); return -1; }
+        job->offsets[i] = pos + 2 + plen + 8;
+        pos = job->offsets[i] + size;
     }
-    closedir(d);
+    free(entry);
+    // El archivo queda con su largo final aunque el último dato lo escriba cualquier hilo
+    if (ftruncate(job->fd_archive, (off_t)pos) != 0) return -1;
+    return 0;
 }
 
 int cesar_encrypt_directory(const char *input_path, const char *output_path, unsigned char key, int num_threads) {
-    cesar_file_count = 0; cesar_next_job = 0; cesar_key_global = key;
-    cesar_scan(input_path);
-    if (cesar_file_count == 0) { printf("Carpeta vacía\n"); return -1; }
-    printf("Encriptando %d archivos con César (clave=%u) usando %d hilos...\n", 
-           cesar_file_count, (unsigned)key, num_threads);
-    
-    pthread_t threads[32];
-    int nt = num_threads > 32 ? 32 : num_threads;
-    for (int i = 0; i < nt; i++) pthread_create(&threads[i], NULL, cesar_worker, (void*)input_path);
-    for (int i = 0; i < nt; i++) pthread_join(threads[i], NULL);
-    
-    // Empaquetar en .csar
-    int fd = open(output_path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
-    if (fd < 0) return -1;
-    write(fd, MAGIC_CSAR, 8);
-    write(fd, &key, 1);
-    unsigned int count = cesar_file_count;
-    write(fd, &count, 4);
-    
-    char buf[8192];
-    for (int i = 0; i < cesar_file_count; i++) {
-        unsigned short plen = strlen(cesar_files[i].path);
-        unsigned long size = cesar_files[i].size;
-        write(fd, &plen, 2);
-        write(fd, cesar_files[i].path, plen);
-        write(fd, &size, 8);
-        
-        int tf = open(cesar_files[i].temp, O_RDONLY);
-        if (tf >= 0) {
-            ssize_t n;
-            while ((n = read(tf, buf, sizeof(buf))) > 0) write(fd, buf, n);
-            close(tf);
-            unlink(cesar_files[i].temp);
-        }
+    CesarJob job = { input_path, {0}, NULL, -1, 0, 0, 0, key, 0, PTHREAD_MUTEX_INITIALIZER };
+    filelist_init(&job.files);
+    if (filelist_scan(&job.files, input_path) != 0) { filelist_free(&job.files); return -1; }
+    if (job.files.count == 0) { printf("Carpeta vacía\n"); filelist_free(&job.files); return -1; }
+    job.offsets = malloc(job.files.count * sizeof(uint64_t));
+    if (!job.offsets) { perror("malloc"); filelist_free(&job.files); return -1; }
+    job.fd_archive = open(output_path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
+    if (job.fd_archive < 0) { perror("open output"); free(job.offsets); filelist_free(&job.files); return -1; }
+    if (cesar_write_layout(&job) != 0) {
+        perror("write output");
+        job.error = 1;
     }
-    close(fd);
+    printf("Encriptando %zu archivos con César (clave=%u) usando %d hilos...\n", 
+           job.files.count, (unsigned)key, num_threads);
+    if (!job.error) run_threads(cesar_worker, &job, num_threads);
+    
+    int error = job.error;
+    if (close(job.fd_archive) != 0) error = 1;
+    // Un .csar a medio escribir no sirve: se borra
+    if (error) unlink(output_path);
+    pthread_mutex_destroy(&job.lock);
+    free(job.offsets);
+    filelist_free(&job.files);
+    if (error) return -1;
     printf("OK: %s\n", output_path);
     return 0;
 }
@@ -199,76 +438,86 @@ int is_csar_archive(const char *path) {
     return r;
 }
 
-static void cesar_mkdirs(const char *path) {
-    char tmp[1024];
-    strncpy(tmp, path, sizeof(tmp)-1);
-    tmp[sizeof(tmp)-1] = 0;
-    for (char *p = tmp; *p; p++) {
-        if (*p == '/' && p != tmp) {
-            *p = 0;
-            mkdir(tmp, 0755);
-            *p = '/';
+// Recorre los encabezados del .csar abierto en job->fd_archive (de archive_size bytes) y anota
+// cada entrada en job->files y la posición de sus datos en job->offsets, sin leer los datos.
+static int cesar_read_layout(CesarJob *job, unsigned int count, uint64_t archive_size) {
+    job->offsets = malloc((count ? count : 1) * sizeof(uint64_t));
+    char *path = malloc(FILELIST_MAX_PATH + 1);
+    if (!job->offsets || !path) { perror("malloc"); free(path); return -1; }
+    uint64_t pos = 13;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned short plen;
+        uint64_t size;
+        if (pread_all(job->fd_archive, &plen, 2, (off_t)pos) != 0 ||
+            pread_all(job->fd_archive, path, plen, (off_t)(pos + 2)) != 0 ||
+            pread_all(job->fd_archive, &size, 8, (off_t)(pos + 2 + plen)) != 0 ||
+            size > archive_size - (pos + 2 + plen + 8)) {
+            fprintf(stderr, "Error: .csar dañado o incompleto (entrada %u)\n", i);
+            free(path);
+            return -1;
         }
+        if (filelist_add(&job->files, path, plen, size, 0) != 0) { perror("malloc"); free(path); return -1; }
+        job->offsets[i] = pos + 2 + plen + 8;
+        pos = job->offsets[i] + size;
     }
-    mkdir(tmp, 0755);  // crear el último directorio también
+    free(path);
+    return 0;
 }
 
-int cesar_decrypt_directory(const char *input_path, const char *output_path, unsigned char key) {
-    int fd = open(input_path, O_RDONLY);
-    if (fd < 0) return -1;
-    char m[8];
-    unsigned char stored_key;
+// Crea con su tamaño final los archivos que se van a escribir de a pedazos desde varios hilos
+static int cesar_prepare_outputs(CesarJob *job) {
+    for (size_t i = 0; i < job->files.count; i++) {
+        uint64_t size = job->files.items[i].size;
+        if (!cesar_multi_chunk(size)) continue;
+        char *full = path_join(job->base, filelist_path(&job->files, i));
+        if (!full) { perror("malloc"); return -1; }
+        mkdirs_for_file(full);
+        int fd = open(full, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int ok = fd >= 0 && ftruncate(fd, (off_t)size) == 0;
+        if (!ok) perror(full);
+        if (fd >= 0) close(fd);
+        free(full);
+        if (!ok) return -1;
+    }
+    return 0;
+}
+
+int cesar_decrypt_directory(const char *input_path, const char *output_path, unsigned char key, int num_threads) {
+    CesarJob job = { output_path, {0}, NULL, -1, 1, 0, 0, (unsigned char)-key, 0, PTHREAD_MUTEX_INITIALIZER };
+    job.fd_archive = open(input_path, O_RDONLY);
+    if (job.fd_archive < 0) { perror("open input"); return -1; }
+    unsigned char head[13];
     unsigned int count;
-    if (read(fd, m, 8) != 8 || memcmp(m, MAGIC_CSAR, 8) != 0) { close(fd); return -1; }
-    if (read(fd, &stored_key, 1) != 1) { close(fd); return -1; }
-    if (stored_key != key) {
+    struct stat st;
+    if (fstat(job.fd_archive, &st) != 0 || st.st_size < (off_t)sizeof(head) ||
+        pread_all(job.fd_archive, head, sizeof(head), 0) != 0 || memcmp(head, MAGIC_CSAR, 8) != 0) {
+        close(job.fd_archive);
+        return -1;
+    }
+    if (head[8] != key) {
         fprintf(stderr, "Error: clave incorrecta (archivo=%u, provista=%u)\n", 
-                (unsigned)stored_key, (unsigned)key);
-        close(fd); return -1;
+                (unsigned)head[8], (unsigned)key);
+        close(job.fd_archive); return -1;
     }
-    if (read(fd, &count, 4) != 4) { close(fd); return -1; }
-    
-    mkdir(output_path, 0755);
-    printf("Desencriptando %u archivos con César (clave=%u)...\n", count, (unsigned)key);
+    memcpy(&count, head + 9, 4);
     
-    char buf[8192];
-    for (unsigned int i = 0; i < count; i++) {
-        unsigned short plen;
-        unsigned long size;
-        if (read(fd, &plen, 2) != 2) break;
-        
-        char path[1024];
-        if (read(fd, path, plen) != plen) break;
-        path[plen] = 0;
-        if (read(fd, &size, 8) != 8) break;
-        
-        char out[2048], tmp[64];
-        sprintf(out, "%s/%s", output_path, path);
-        sprintf(tmp, ".dctmp_%u.ces", i);
-        
-        // Crear directorios intermedios incluyendo output_path
-        char dir_path[2048];
-        strncpy(dir_path, out, sizeof(dir_path)-1);
-        dir_path[sizeof(dir_path)-1] = 0;
-        char *slash = strrchr(dir_path, '/');
-        if (slash) {
-            *slash = 0;
-            cesar_mkdirs(dir_path);
-        }
-        
-        int tf = open(tmp, O_CREAT|O_TRUNC|O_WRONLY, 0644);
-        unsigned long left = size;
-        while (left > 0) {
-            size_t n = left > sizeof(buf) ? sizeof(buf) : left;
-            if (read(fd, buf, n) != (ssize_t)n) break;
-            write(tf, buf, n);
-            left -= n;
-        }
-        close(tf);
-        cesar_decrypt_file(tmp, out, key);
-        unlink(tmp);
+    filelist_init(&job.files);
+    if (cesar_read_layout(&job, count, (uint64_t)st.st_size) != 0) job.error = 1;
+    if (!job.error) {
+        mkdir(output_path, 0755);
+        if (cesar_prepare_outputs(&job) != 0) job.error = 1;
     }
-    close(fd);
+    if (!job.error) {
+        printf("Desencriptando %u archivos con César (clave=%u) usando %d hilos...\n",
+               count, (unsigned)key, num_threads);
+        run_threads(cesar_worker, &job, num_threads);
+    }
+    
+    close(job.fd_archive);
+    pthread_mutex_destroy(&job.lock);
+    free(job.offsets);
+    filelist_free(&job.files);
+    if (job.error) return -1;
     printf("OK: %s\n", output_path);
     return 0;
 }
@@ -1,12 +1,21 @@
-
+#include <stddef.h>
 
 // Encriptar/desencriptar archivo individual
 int cesar_encrypt_file(const char *input_path, const char *output_path, unsigned char key);
 int cesar_decrypt_file(const char *input_path, const char *output_path, unsigned char key);
 
+// Igual, pero un archivo grande se reparte por rangos entre num_threads hilos
+int cesar_encrypt_file_mt(const char *input_path, const char *output_path, unsigned char key, int num_threads);
+int cesar_decrypt_file_mt(const char *input_path, const char *output_path, unsigned char key, int num_threads);
+
+// Encriptar/desencriptar len bytes de src a dst, en memoria (src y dst pueden ser el mismo buffer).
+// La transformación no depende de la posición, así que un flujo se puede procesar por pedazos.
+void cesar_encrypt_buffer(const unsigned char *src, unsigned char *dst, size_t len, unsigned char key);
+void cesar_decrypt_buffer(const unsigned char *src, unsigned char *dst, size_t len, unsigned char key);
+
 // Encriptar/desencriptar carpeta con hilos (crea .csar = César Archive)
 int cesar_encrypt_directory(const char *input_path, const char *output_path, unsigned char key, int num_threads);
-int cesar_decrypt_directory(const char *input_path, const char *output_path, unsigned char key);
+int cesar_decrypt_directory(const char *input_path, const char *output_path, unsigned char key, int num_threads);
 
 // Detectar si es un archivo .csar
 int is_csar_archive(const char *path);
\ No newline at end of file
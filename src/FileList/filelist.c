@@ -0,0 +1,266 @@
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE  // DT_DIR, DT_REG... de readdir
+#include "filelist.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+
+void filelist_init(FileList *l) {
+    memset(l, 0, sizeof(*l));
+}
+
+void filelist_free(FileList *l) {
+    free(l->paths);
+    free(l->items);
+    memset(l, 0, sizeof(*l));
+}
+
+int filelist_add(FileList *l, const char *rel, size_t len, uint64_t size, int64_t mtime) {
+    // Ambos arreglos crecen al doble, así agregar es O(1) amortizado
+    if (l->paths_len + len + 1 > l->paths_cap) {
+        size_t cap = l->paths_cap ? l->paths_cap * 2 : 4096;
+        while (cap < l->paths_len + len + 1) cap *= 2;
+        char *bigger = realloc(l->paths, cap);
+        if (!bigger) return -1;
+        l->paths = bigger;
+        l->paths_cap = cap;
+    }
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        FileEntry *bigger = realloc(l->items, cap * sizeof(FileEntry));
+        if (!bigger) return -1;
+        l->items = bigger;
+        l->cap = cap;
+    }
+    FileEntry *e = &l->items[l->count++];
+    e->path = l->paths_len;
+    e->size = size;
+    e->mtime = mtime;
+    memcpy(l->paths + l->paths_len, rel, len);
+    l->paths[l->paths_len + len] = 0;
+    l->paths_len += len + 1;
+    return 0;
+}
+
+char* path_join(const char *base, const char *rel) {
+    size_t bl = strlen(base), rl = strlen(rel);
+    char *p = malloc(bl + 1 + rl + 1);
+    if (!p) return NULL;
+    memcpy(p, base, bl);
+    p[bl] = '/';
+    memcpy(p + bl + 1, rel, rl + 1);
+    return p;
+}
+
+// Estado del recorrido: rel es la ruta relativa a la carpeta inicial de lo que se está viendo
+// (crece según haga falta). Las carpetas se abren relativas a la carpeta padre con openat,
+// así nunca se arma la ruta completa ni se resuelve de nuevo desde la raíz.
+typedef struct {
+    filelist_visit_fn visit;
+    void *ctx;
+    char *rel;
+    size_t rel_cap;
+    int error;
+} WalkState;
+
+static int grow(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return 0;
+    size_t c = *cap ? *cap : 256;
+    while (c < need) c *= 2;
+    char *bigger = realloc(*buf, c);
+    if (!bigger) return -1;
+    *buf = bigger;
+    *cap = c;
+    return 0;
+}
+
+// Recorre la carpeta abierta dfd (ruta relativa w->rel[0..rel_len)); cierra dfd al terminar
+static void walk_dir(WalkState *w, int dfd, size_t rel_len) {
+    DIR *d = fdopendir(dfd);
+    if (!d) {
+        close(dfd);
+        return;
+    }
+    struct dirent *e;
+    while (!w->error && (e = readdir(d))) {
+        if (e->d_name[0] == '.') continue;
+
+        size_t nl = strlen(e->d_name);
+        size_t rl = rel_len + (rel_len ? 1 : 0) + nl;
+        if (grow(&w->rel, &w->rel_cap, rl + 1) != 0) {
+            perror("malloc");
+            w->error = 1;
+            break;
+        }
+        if (rel_len) w->rel[rel_len] = '/';
+        memcpy(w->rel + rl - nl, e->d_name, nl + 1);
+
+        // d_type ya dice si es carpeta: ahí no hace falta stat. Los archivos sí necesitan
+        // fstatat (por el tamaño), igual que los enlaces simbólicos y los sistemas de archivos
+        // que no informan el tipo (DT_UNKNOWN). Lo demás (fifos, sockets...) se ignora.
+        struct stat st;
+        int is_dir = 0;
+        if (e->d_type == DT_DIR) {
+            is_dir = 1;
+        } else if (e->d_type == DT_REG || e->d_type == DT_LNK || e->d_type == DT_UNKNOWN) {
+            if (fstatat(dirfd(d), e->d_name, &st, 0) != 0) continue;
+            if (S_ISDIR(st.st_mode)) {
+                is_dir = 1;
+            } else if (!S_ISREG(st.st_mode)) {
+                continue;
+            }
+        } else {
+            continue;
+        }
+
+        if (is_dir) {
+            int sub = openat(dirfd(d), e->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (sub >= 0) walk_dir(w, sub, rl);
+        } else if (rl > FILELIST_MAX_PATH) {
+            fprintf(stderr, "Ruta demasiado larga, se omite: %s\n", w->rel);
+        } else if (w->visit(w->ctx, w->rel, rl, (uint64_t)st.st_size,
+                            (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec) != 0) {
+            w->error = 1;
+        }
+    }
+    closedir(d);
+}
+
+int filelist_walk(const char *dir, filelist_visit_fn visit, void *ctx) {
+    WalkState w = { visit, ctx, NULL, 0, 0 };
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return 0;  // carpeta que no se puede abrir: no tiene archivos
+    if (grow(&w.rel, &w.rel_cap, 1) != 0) {
+        perror("malloc");
+        close(dfd);
+        return -1;
+    }
+    w.rel[0] = 0;
+    walk_dir(&w, dfd, 0);
+    free(w.rel);
+    return w.error ? -1 : 0;
+}
+
+static int add_to_list(void *ctx, const char *rel, size_t len, uint64_t size, int64_t mtime) {
+    if (filelist_add(ctx, rel, len, size, mtime) != 0) {
+        perror("malloc");
+        return -1;
+    }
+    return 0;
+}
+
+int filelist_scan(FileList *l, const char *dir) {
+    return filelist_walk(dir, add_to_list, l);
+}
+
+void mkdirs(const char *path) {
+    char *tmp = strdup(path);
+    if (!tmp) return;
+    for (char *p = tmp; *p; p++) {
+        if (*p == '/' && p != tmp) {
+            *p = 0;
+            mkdir(tmp, 0755);
+            *p = '/';
+        }
+    }
+    mkdir(tmp, 0755);  // crear el último directorio también
+    free(tmp);
+}
+
+void mkdirs_for_file(const char *file) {
+    char *dir = strdup(file);
+    if (!dir) return;
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = 0;
+        mkdirs(dir);
+    }
+    free(dir);
+}
+
+int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+ssize_t read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = read(fd, p + got, len - got);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) break;
+        got += (size_t)r;
+    }
+    return (ssize_t)got;
+}
+
+int pwrite_all(int fd, const void *buf, size_t len, off_t off) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t w = pwrite(fd, p, len, off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        off += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+int pread_all(int fd, void *buf, size_t len, off_t off) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t r = pread(fd, p, len, off);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return -1;
+        p += r;
+        off += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+int open_input(const char *path) {
+    if (strcmp(path, "-") == 0) return dup(STDIN_FILENO);
+    return open(path, O_RDONLY);
+}
+
+int open_output(const char *path) {
+    if (strcmp(path, "-") == 0) return dup(STDOUT_FILENO);
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+void run_threads(void *(*fn)(void *), void *arg, int num_threads) {
+    pthread_t threads[MAX_THREADS];
+    int nt = num_threads > MAX_THREADS ? MAX_THREADS : num_threads;
+    int started = 0;
+    for (int i = 1; i < nt; i++) {
+        if (pthread_create(&threads[started], NULL, fn, arg) == 0) started++;
+    }
+    fn(arg);   // el que llama también trabaja
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
@@ -0,0 +1,86 @@
+// filelist.h - Lista de archivos de una carpeta, sin límite de cantidad ni de largo de ruta,
+// y las funciones de E/S e hilos que comparten todos los módulos
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Cada entrada guarda dónde empieza su ruta dentro del arena y los datos del stat.
+// Las rutas van todas seguidas en un solo buffer (terminadas en '\0'), así una entrada
+// cuesta 24 bytes más el largo de su ruta, sin importar cuántas haya.
+typedef struct {
+    size_t path;      // posición de la ruta relativa dentro de FileList.paths
+    uint64_t size;    // tamaño en bytes
+    int64_t mtime;    // fecha de modificación (nanosegundos desde 1970)
+} FileEntry;
+
+typedef struct {
+    char *paths;          // arena de rutas
+    size_t paths_len;
+    size_t paths_cap;
+    FileEntry *items;     // entradas en el orden en que se agregaron
+    size_t count;
+    size_t cap;
+} FileList;
+
+// Las rutas de los .har y .csar se guardan con largo u16
+#define FILELIST_MAX_PATH 65535
+
+void filelist_init(FileList *l);
+void filelist_free(FileList *l);
+
+// Agrega una entrada copiando rel[0..len) al arena. Devuelve 0 si OK, -1 si no hay memoria.
+int filelist_add(FileList *l, const char *rel, size_t len, uint64_t size, int64_t mtime);
+
+// Ruta relativa de la entrada i (válida hasta el próximo filelist_add)
+static inline const char* filelist_path(const FileList *l, size_t i) {
+    return l->paths + l->items[i].path;
+}
+
+// Recorre la carpeta dir (y sus subcarpetas) llamando a visit por cada archivo regular, con su
+// ruta relativa a dir (rel[0..len), terminada en '\0'; se reutiliza después de la llamada), su
+// tamaño y su mtime (en nanosegundos, así se notan los cambios dentro del mismo segundo).
+// Ignora los nombres que empiezan con '.'. Si visit devuelve algo distinto de 0 el recorrido
+// se detiene. Devuelve 0 si OK, -1 si visit lo detuvo o no hubo memoria.
+typedef int (*filelist_visit_fn)(void *ctx, const char *rel, size_t len, uint64_t size, int64_t mtime);
+int filelist_walk(const char *dir, filelist_visit_fn visit, void *ctx);
+
+// Igual que filelist_walk, pero agrega cada archivo a l. Devuelve 0 si OK, -1 si no hubo memoria.
+int filelist_scan(FileList *l, const char *dir);
+
+// "base/rel" en memoria nueva (se libera con free). NULL si no hay memoria.
+char* path_join(const char *base, const char *rel);
+
+// Crea el directorio path y todos los que le faltan antes. Si otro hilo crea alguno
+// al mismo tiempo, mkdir falla con EEXIST y se sigue sin problema.
+void mkdirs(const char *path);
+
+// Crea los directorios que le faltan a la ruta de archivo 'file' (todo antes de la última '/')
+void mkdirs_for_file(const char *file);
+
+// # E/S
+// Todas reintentan si la llamada es interrumpida (EINTR) o hace menos de lo pedido.
+
+// Escribe los len bytes. Devuelve 0 si OK, -1 si error (con errno).
+int write_all(int fd, const void *buf, size_t len);
+
+// Lee hasta len bytes (menos solo si se termina la entrada). Devuelve cuántos leyó o -1 si error.
+ssize_t read_full(int fd, void *buf, size_t len);
+
+// Como write_all/read_full pero en la posición off, sin mover la del archivo: varios hilos
+// pueden usar el mismo descriptor. pread_all devuelve -1 también si el archivo es más corto.
+int pwrite_all(int fd, const void *buf, size_t len, off_t off);
+int pread_all(int fd, void *buf, size_t len, off_t off);
+
+// "-" como ruta significa entrada o salida estándar (para usar el programa en pipes).
+// Se duplica el descriptor para poder cerrarlo igual que un archivo normal.
+int open_input(const char *path);
+int open_output(const char *path);
+
+// # Hilos
+// Cantidad máxima de hilos de cualquier operación
+#define MAX_THREADS 32
+
+// Corre fn(arg) en num_threads hilos (entre 1 y MAX_THREADS), contando al que llama, que
+// también trabaja, y vuelve cuando terminaron todos. Si no se puede crear ningún hilo más,
+// el que llama hace todo el trabajo solo.
+void run_threads(void *(*fn)(void *), void *arg, int num_threads);
@@ -1,25 +1,30 @@
 #include "huffman.h"
+#include "../FileList/filelist.h"   // E/S e hilos compartidos
 
 #include <unistd.h>   // read, write, close, lseek
 #include <fcntl.h>    // open, O_RDONLY, O_WRONLY, O_CREAT...
-#include <stdlib.h>   // malloc, free, exit
+#include <stdlib.h>   // malloc, free
 #include <string.h>   // memset, memcpy
 #include <stdio.h>    // solo para pse utiliza para imprimir por consola
+#include <errno.h>    // errno, EINTR
+#include <pthread.h>  // hilos para comprimir bloques en paralelo
+#include <sys/stat.h> // fstat
+#include <sys/mman.h> // mmap, madvise
 
 // Inicializa el heap vacío
 static void heap_init(MinHeap *h) {
     h->size = 0;
 }
 
-// Intercambia dos punteros dentro del heap
-static void heap_swap(Node **a, Node **b) {
-    Node *tmp = *a;
+// Intercambia dos índices dentro del heap
+static void heap_swap(int16_t *a, int16_t *b) {
+    int16_t tmp = *a;
     *a = *b;
     *b = tmp;
 }
 
 // Inserta un nodo en el heap manteniendo orden por frecuencia (min-heap), siempre los de menos frecuencia
-static void heap_insert(MinHeap *h, Node *node) {
+static void heap_insert(MinHeap *h, const HuffTree *t, int16_t node) {
     int i = h->size;
     h->data[i] = node;
     h->size++;
@@ -27,7 +32,7 @@ static void heap_insert(MinHeap *h, Node *node) {
     // mientras el nodo sea más pequeño que su padre, sube
     while (i > 0) {
         int parent = (i - 1) / 2;
-        if (h->data[parent]->freq <= h->data[i]->freq) {
+        if (t->nodes[h->data[parent]].freq <= t->nodes[h->data[i]].freq) {
             break;
         }
         heap_swap(&h->data[parent], &h->data[i]);
@@ -35,11 +40,11 @@ static void heap_insert(MinHeap *h, Node *node) {
     }
 }
 
-// Saca el nodo con menor frecuencia del heap
-static Node* heap_extract_min(MinHeap *h) {
-    if (h->size == 0) return NULL;
+// Saca el nodo con menor frecuencia del heap (-1 si está vacío)
+static int16_t heap_extract_min(MinHeap *h, const HuffTree *t) {
+    if (h->size == 0) return -1;
 
-    Node *min = h->data[0];          // raíz del heap = mínimo
+    int16_t min = h->data[0];        // raíz del heap = mínimo
     h->size--;
     h->data[0] = h->data[h->size];   // movemos el último a la raíz
 
@@ -50,10 +55,10 @@ static Node* heap_extract_min(MinHeap *h) {
         int right = 2*i + 2;
         int smallest = i;
 
-        if (left < h->size && h->data[left]->freq < h->data[smallest]->freq) {
+        if (left < h->size && t->nodes[h->data[left]].freq < t->nodes[h->data[smallest]].freq) {
             smallest = left;
         }
-        if (right < h->size && h->data[right]->freq < h->data[smallest]->freq) {
+        if (right < h->size && t->nodes[h->data[right]].freq < t->nodes[h->data[smallest]].freq) {
             smallest = right;
         }
         if (smallest == i) {
@@ -67,412 +72,1714 @@ static Node* heap_extract_min(MinHeap *h) {
 }
 
 
-// Crea un nodo
-static Node* make_node(unsigned char byte, uint64_t freq, Node *left, Node *right) {
-    Node *n = (Node*) malloc(sizeof(Node));
-    if (!n) {
-        perror("malloc");
-        exit(1);
-    }
+// Crea un nodo en el siguiente hueco libre del árbol y devuelve su índice.
+// Nunca se queda sin espacio: 256 hojas + 255 padres (o hoja + dummy + padre) caben en HUFF_MAX_NODES.
+static int16_t make_node(HuffTree *t, unsigned char byte, uint64_t freq, int16_t left, int16_t right) {
+    int16_t idx = (int16_t)t->count++;
+    Node *n = &t->nodes[idx];
     n->byte = byte;
     n->freq = freq;
     n->left = left;
     n->right = right;
-    return n;
-}
-
-// Libera recursivamente el árbol
-static void free_tree(Node *root) {
-    if (!root) return;
-    free_tree(root->left);
-    free_tree(root->right);
-    free(root);
+    return idx;
 }
 
 
-// Se construye el árbol con respecto a sus frecuencias
-
-static Node* build_huffman_tree(uint64_t freq[256]) {
+// Se construye el árbol con respecto a sus frecuencias, dentro de t (sin memoria dinámica).
+// Si no hay ningún símbolo, t->root queda en -1.
+static void build_huffman_tree(HuffTree *t, const uint64_t freq[256]) {
     MinHeap heap;
     heap_init(&heap);
+    t->count = 0;
+    t->root = -1;
 
     // Por cada byte (letra/símbolo) que apareció al menos una vez, creamos un nodo hoja y lo metemos al heap.
     for (int b = 0; b < 256; b++) {
         if (freq[b] > 0) {
-            Node *leaf = make_node((unsigned char)b, freq[b], NULL, NULL);
-            heap_insert(&heap, leaf);
+            int16_t leaf = make_node(t, (unsigned char)b, freq[b], -1, -1);
+            heap_insert(&heap, t, leaf);
         }
     }
 
     if (heap.size == 0) {
-        return NULL;
+        return;
     }
 
     // Cuando solo hay una letra/simbolo/etc en el archivo
     if (heap.size == 1) {
-        Node *only = heap_extract_min(&heap);
-        Node *dummy = make_node(0, 0, NULL, NULL);
-        Node *parent = make_node(0, only->freq, only, dummy);
-        return parent;
+        int16_t only = heap_extract_min(&heap, t);
+        int16_t dummy = make_node(t, 0, 0, -1, -1);
+        t->root = make_node(t, 0, t->nodes[only].freq, only, dummy);
+        return;
     }
 
     // Mientras haya más de un nodo sacar los 2 más pequeños en frecuencia y combinarlos en un nodo padre
     while (heap.size > 1) {
-        Node *a = heap_extract_min(&heap);
-        Node *b = heap_extract_min(&heap);
+        int16_t a = heap_extract_min(&heap, t);
+        int16_t b = heap_extract_min(&heap, t);
 
-        Node *parent = make_node(
-            0,              
-            a->freq + b->freq,
+        int16_t parent = make_node(
+            t,
+            0,
+            t->nodes[a].freq + t->nodes[b].freq,
             a,              // hijo izquierdo
             b               // hijo derecho
         );
 
-        heap_insert(&heap, parent);
+        heap_insert(&heap, t, parent);
     }
 
     // El único nodo que queda es la raíz del árbol.
-    return heap_extract_min(&heap);
+    t->root = heap_extract_min(&heap, t);
 }
 
 // # Creamos el archivo .huff. Donde un Byte -> secuencia de bits (8 bits)
-// Recorremos el árbol. Cada vez que bajamos a la izquierda agregamos un 0, a la derecha agregamos un 1.
-static void build_codes_rec(Node *root,
-                            Code codes[256],
-                            uint32_t curr_code,
-                            uint32_t curr_len) {
-    if (!root) return;
-
-    // Si es hoja, registramos su código.
-    if (root->left == NULL && root->right == NULL) {
-        codes[root->byte].code   = curr_code;
-        codes[root->byte].length = curr_len;
+// Recorremos el árbol para saber la profundidad (longitud del código) de cada hoja.
+// Solo guardamos la longitud: los bits concretos se asignan después de forma canónica.
+static void build_lengths_rec(const HuffTree *t, int idx, uint8_t lengths[256], uint32_t depth) {
+    if (idx < 0) return;
+    const Node *n = &t->nodes[idx];
+
+    // Si es hoja, registramos su longitud (la hoja "dummy" de frecuencia 0 no cuenta)
+    if (n->left < 0 && n->right < 0) {
+        if (n->freq > 0) {
+            lengths[n->byte] = (uint8_t)(depth > 255 ? 255 : depth);
+        }
         return;
     }
 
-    // Ir a la izquierda: agregamos un 0
-    build_codes_rec(root->left,
-                    codes,
-                    (curr_code << 1) | 0,
-                    curr_len + 1);
+    build_lengths_rec(t, n->left, lengths, depth + 1);
+    build_lengths_rec(t, n->right, lengths, depth + 1);
+}
+
+// Limita las longitudes a max_len bits sin romper el código prefijo (desigualdad de Kraft).
+// 1. Los códigos más largos que max_len se recortan a max_len.
+// 2. Si eso deja la suma de Kraft por encima de 1, alargamos de a un bit los códigos menos
+//    frecuentes entre los más largos que aún pueden crecer, hasta que vuelva a caber.
+// 3. Si sobra espacio, acortamos los símbolos más frecuentes mientras se pueda.
+// Con max_len >= 8 siempre hay solución: 256 símbolos de 8 bits llenan el código justo.
+static void limit_lengths(uint8_t lengths[256], const uint64_t freq[256], int max_len) {
+    // Símbolos presentes ordenados de más a menos frecuente
+    int order[256];
+    int n = 0;
+    for (int i = 0; i < 256; i++) {
+        if (lengths[i] == 0) continue;
+        int j = n++;
+        while (j > 0 && freq[order[j - 1]] < freq[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
 
-    // Ir a la derecha: agregamos un 1
-    build_codes_rec(root->right,
-                    codes,
-                    (curr_code << 1) | 1,
-                    curr_len + 1);
+    // Kraft en unidades de 2^-max_len: el código es válido mientras kraft <= 2^max_len
+    const uint64_t limit = (uint64_t)1 << max_len;
+    uint64_t kraft = 0;
+    for (int k = 0; k < n; k++) {
+        int s = order[k];
+        if (lengths[s] > max_len) lengths[s] = (uint8_t)max_len;
+        kraft += (uint64_t)1 << (max_len - lengths[s]);
+    }
+
+    while (kraft > limit) {
+        // El más largo que todavía puede crecer; entre iguales, el menos frecuente (el último)
+        int best = -1;
+        for (int k = n - 1; k >= 0; k--) {
+            int s = order[k];
+            if (lengths[s] < max_len && (best < 0 || lengths[s] > lengths[best])) best = s;
+        }
+        kraft -= (uint64_t)1 << (max_len - lengths[best] - 1);
+        lengths[best]++;
+    }
+
+    for (int k = 0; k < n; k++) {
+        int s = order[k];
+        while (lengths[s] > 1 && kraft + ((uint64_t)1 << (max_len - lengths[s])) <= limit) {
+            kraft += (uint64_t)1 << (max_len - lengths[s]);
+            lengths[s]--;
+        }
+    }
 }
 
-static void build_codes(Node *root, Code codes[256]) {
+// Longitudes de código limitadas a max_len bits a partir de las frecuencias
+static void build_lengths(const uint64_t freq[256], uint8_t lengths[256], int max_len) {
+    memset(lengths, 0, 256);
+    HuffTree tree;
+    build_huffman_tree(&tree, freq);
+    build_lengths_rec(&tree, tree.root, lengths, 0);
+    limit_lengths(lengths, freq, max_len);
+}
+
+// Códigos canónicos: a partir de las longitudes, los símbolos se ordenan por (longitud, byte)
+// y reciben códigos consecutivos. Así el decodificador puede reconstruir exactamente los mismos
+// códigos conociendo solo las longitudes.
+// Devuelve 0 si todo bien, -1 si algún código no cabe en 32 bits.
+static int build_canonical_codes(const uint8_t lengths[256], Code codes[256]) {
+    uint32_t bl_count[256] = {0};
     for (int i = 0; i < 256; i++) {
-        codes[i].code = 0;
-        codes[i].length = 0;
+        bl_count[lengths[i]]++;
+    }
+    bl_count[0] = 0;
+
+    for (int len = 33; len < 256; len++) {
+        if (bl_count[len] > 0) return -1;
+    }
+
+    uint32_t next_code[33];
+    uint32_t code = 0;
+    next_code[0] = 0;
+    for (int len = 1; len <= 32; len++) {
+        code = (code + bl_count[len - 1]) << 1;
+        next_code[len] = code;
     }
-    build_codes_rec(root, codes, 0, 0);
+
+    for (int i = 0; i < 256; i++) {
+        codes[i].length = lengths[i];
+        codes[i].code = lengths[i] ? next_code[lengths[i]]++ : 0;
+    }
+    return 0;
 }
 
-// Esta estructura acumula bits hasta formar bytes
+// Tamaño de los buffers de E/S: leemos y escribimos en bloques grandes
+// para no hacer una llamada al sistema por cada byte.
+#define HUFF_IO_BUF_SIZE (1 << 20)
+
+// Esta estructura acumula bits en una palabra de 64 bits y los pasa de 32 en 32
+// a un buffer de salida grande, que se escribe al archivo con un solo write() cuando se llena.
+// Con fd = -1 no hay archivo: el buffer crece y el resultado queda en memoria.
 typedef struct {
     int fd;            // file descriptor POSIX de salida -> Identificador único dentro del sistema operativo que le permite al kernel saber que archivo le estas diciendo que abra
-    uint8_t buffer;    // acumulador de bits
-    int bit_count;     // cuántos bits hay ya en buffer
+    uint8_t *buf;      // buffer de salida
+    size_t len;        // bytes ya escritos en buf
+    size_t cap;        // capacidad de buf
+    uint64_t acc;      // acumulador de bits (los bits válidos son los nbits menos significativos)
+    int nbits;         // cuántos bits hay ya en el acumulador (siempre < 32 entre llamadas)
+    int error;         // 1 si falló algún write() o no hubo memoria
 } BitWriter;
 
-// Inicializa el BitWriter
-static void bw_init(BitWriter *bw, int fd) {
+// Inicializa el BitWriter hacia un archivo, usando 'buf' (HUFF_IO_BUF_SIZE bytes) como buffer
+static void bw_init(BitWriter *bw, int fd, uint8_t *buf) {
     bw->fd = fd;
-    bw->buffer = 0;
-    bw->bit_count = 0;
+    bw->buf = buf;
+    bw->len = 0;
+    bw->cap = HUFF_IO_BUF_SIZE;
+    bw->acc = 0;
+    bw->nbits = 0;
+    bw->error = 0;
+}
+
+// Inicializa el BitWriter en memoria; el buffer lo libera quien lo usa (free(bw->buf))
+static void bw_init_mem(BitWriter *bw, size_t cap) {
+    bw_init(bw, -1, malloc(cap));
+    bw->cap = cap;
+    if (!bw->buf) {
+        bw->error = 1;
+        bw->cap = 0;
+    }
+}
+
+// Hace espacio en el buffer de salida: lo manda al archivo o, en memoria, lo agranda
+static void bw_drain(BitWriter *bw) {
+    if (bw->fd < 0) {
+        uint8_t *bigger = bw->error ? NULL : realloc(bw->buf, bw->cap * 2 + 64);
+        if (!bigger) {
+            // Sin memoria: descartamos lo escrito para no salirnos del buffer
+            bw->error = 1;
+            bw->len = 0;
+            return;
+        }
+        bw->buf = bigger;
+        bw->cap = bw->cap * 2 + 64;
+        return;
+    }
+    if (bw->len > 0 && !bw->error && write_all(bw->fd, bw->buf, bw->len) != 0) {
+        perror("write");
+        bw->error = 1;
+    }
+    bw->len = 0;
 }
 
-// Escribe un bit (0 o 1) en el buffer interno.
-// Cuando acumulamos 8 bits, escribimos 1 byte al archivo con write().
-static void bw_write_bit(BitWriter *bw, int bit) {
-    bw->buffer = (bw->buffer << 1) | (bit & 1);
-    bw->bit_count++;
+// Agrega un código completo (hasta 32 bits) al acumulador, del bit más significativo al menos.
+// Cada vez que se juntan 32 bits los copiamos al buffer de salida como 4 bytes.
+static inline void bw_write_code(BitWriter *bw, uint32_t code, uint32_t length) {
+    bw->acc = (bw->acc << length) | code;
+    bw->nbits += length;
+
+    if (bw->nbits >= 32) {
+        bw->nbits -= 32;
+        uint32_t word = (uint32_t)(bw->acc >> bw->nbits);
+        bw->buf[bw->len++] = (uint8_t)(word >> 24);
+        bw->buf[bw->len++] = (uint8_t)(word >> 16);
+        bw->buf[bw->len++] = (uint8_t)(word >> 8);
+        bw->buf[bw->len++] = (uint8_t)word;
+        if (bw->len + 4 > bw->cap) {
+            bw_drain(bw);
+        }
+    }
+}
 
-    if (bw->bit_count == 8) {
-        // ya tenemos un byte completo
-        ssize_t w = write(bw->fd, &bw->buffer, 1);
-        if (w != 1) {
-            perror("write");
-            exit(1);
+// Copia bytes tal cual al buffer de salida (solo fuera de los bits: headers, índices)
+static void bw_put_bytes(BitWriter *bw, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t*)data;
+    while (len > 0) {
+        if (bw->len == bw->cap) {
+            bw_drain(bw);
+            if (bw->len == bw->cap) return;
         }
-        bw->bit_count = 0;
-        bw->buffer = 0;
+        size_t room = bw->cap - bw->len;
+        size_t n = len < room ? len : room;
+        memcpy(bw->buf + bw->len, p, n);
+        bw->len += n;
+        p += n;
+        len -= n;
+    }
+    if (bw->len + 4 > bw->cap) {
+        bw_drain(bw);
     }
 }
 
-static void bw_write_code(BitWriter *bw, uint32_t code, uint32_t length) {
-    // Recorremos de más significativo a menos significativo.
-    for (int i = length - 1; i >= 0; i--) {
-        int bit = (code >> i) & 1;
-        bw_write_bit(bw, bit);
+// Si hay bits "sueltos", los empujamos al buffer alineando con ceros a la derecha
+static void bw_align(BitWriter *bw) {
+    while (bw->nbits >= 8) {
+        bw->nbits -= 8;
+        uint8_t b = (uint8_t)(bw->acc >> bw->nbits);
+        bw_put_bytes(bw, &b, 1);
+    }
+    if (bw->nbits > 0) {
+        uint8_t b = (uint8_t)(bw->acc << (8 - bw->nbits));
+        bw_put_bytes(bw, &b, 1);
+        bw->nbits = 0;
     }
+    bw->acc = 0;
 }
 
-// Al final, si hay bits "sueltos", los empujamos alineando con ceros a la derecha.
+// Al final, alineamos y escribimos lo que quede en el buffer
 static void bw_flush(BitWriter *bw) {
-    if (bw->bit_count > 0) {
-        bw->buffer <<= (8 - bw->bit_count);
+    bw_align(bw);
+    if (bw->fd >= 0) bw_drain(bw);
+}
 
-        ssize_t w = write(bw->fd, &bw->buffer, 1);
-        if (w != 1) {
-            perror("write");
-            exit(1);
-        }
-        bw->bit_count = 0;
-        bw->buffer = 0;
+// Agrega bytes ya armados (por ejemplo un bloque comprimido completo). Hacia un archivo se
+// escriben directo con write(), sin copiarlos al buffer; en memoria se agregan al final.
+static void bw_write_raw(BitWriter *bw, const uint8_t *data, size_t len) {
+    if (bw->fd < 0) {
+        bw_put_bytes(bw, data, len);
+        return;
+    }
+    bw_drain(bw);
+    if (!bw->error && write_all(bw->fd, data, len) != 0) {
+        perror("write");
+        bw->error = 1;
     }
 }
 
-// Bit reader 
+// Bit reader: mantiene hasta 64 bits en un acumulador alineado al bit más significativo
+// y lo rellena desde un buffer de entrada grande que a su vez se llena con read().
 typedef struct {
     int fd;            // file descriptor POSIX de entrada
-    uint8_t buffer;    // byte actual
-    int bit_count;     // cuántos bits quedan sin leer en el buffer
-    int eof;           // marcamos si ya no hay más bits que leer (acabamos de leer el archivo)
+    uint8_t *buf;      // buffer de entrada
+    size_t len;        // bytes válidos en buf
+    size_t pos;        // siguiente byte de buf por consumir
+    uint64_t bits;     // acumulador de bits (el siguiente bit es el más significativo)
+    int nbits;         // cuántos bits válidos hay en el acumulador
+    int eof;           // marcamos si ya no hay más bytes que leer del archivo
+    int error;         // 1 si read() falló
 } BitReader;
 
-static void br_init(BitReader *br, int fd) {
+static void br_init(BitReader *br, int fd, uint8_t *buf) {
     br->fd = fd;
-    br->buffer = 0;
-    br->bit_count = 0;
+    br->buf = buf;
+    br->len = 0;
+    br->pos = 0;
+    br->bits = 0;
+    br->nbits = 0;
     br->eof = 0;
+    br->error = 0;
 }
 
-// Devuelve 1 si pudo leer un bit y lo pone en *bit_out.
-// Devuelve 0 si ya no hay más bits (eof en el archivo comprimido .huff)
-static int br_read_bit(BitReader *br, int *bit_out) {
-    // Si ya le+imos los bits del buffer anterior, leer un byte nuevo
-    if (br->bit_count == 0) {
-        uint8_t tmp;
-        ssize_t r = read(br->fd, &tmp, 1);
-        if (r == 0) {
-            // no más datos en el archivo
-            br->eof = 1;
-            return 0;
-        } else if (r < 0) {
+// Bit reader sobre un bloque que ya está completo en memoria
+static void br_init_mem(BitReader *br, const uint8_t *src, size_t len) {
+    br_init(br, -1, (uint8_t*)src);
+    br->len = len;
+    br->eof = 1;
+}
+
+// Lee big-endian 8 bytes de una vez
+static inline uint64_t load_be64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+// Carga más bytes del archivo en el buffer de entrada. Devuelve 0 si no hay más.
+static size_t br_fill(BitReader *br) {
+    if (br->eof) return 0;
+    ssize_t r = read(br->fd, br->buf, HUFF_IO_BUF_SIZE);
+    if (r <= 0) {
+        if (r < 0) {
             perror("read");
-            exit(1);
+            br->error = 1;
+        }
+        br->eof = 1;
+        return 0;
+    }
+    br->len = (size_t)r;
+    br->pos = 0;
+    return br->len;
+}
+
+// Rellena el acumulador hasta tener al menos 57 bits (o hasta que se acabe el archivo).
+// Los bits que faltan al final del archivo quedan en cero.
+static inline void br_refill(BitReader *br) {
+    // Camino rápido: quedan 8 bytes en el buffer, cargamos de una vez
+    if (br->pos + 8 <= br->len) {
+        br->bits |= load_be64(br->buf + br->pos) >> br->nbits;
+        int bytes = (63 - br->nbits) >> 3;
+        br->pos += bytes;
+        br->nbits += bytes * 8;
+        return;
+    }
+
+    // Camino lento: byte a byte, leyendo más del archivo cuando el buffer se vacía
+    while (br->nbits <= 56) {
+        if (br->pos == br->len) {
+            if (br_fill(br) == 0) return;
+            if (br->len >= 8) {
+                br_refill(br);
+                return;
+            }
+        }
+        br->bits |= (uint64_t)br->buf[br->pos++] << (56 - br->nbits);
+        br->nbits += 8;
+    }
+}
+
+// Descarta n bits ya usados del acumulador
+static inline void br_consume(BitReader *br, int n) {
+    br->bits <<= n;
+    br->nbits -= n;
+}
+
+
+// Lee un byte completo desde el buffer de entrada (solo fuera de los bits: headers, índices).
+// Devuelve -1 si se acabó el archivo.
+static int br_get_byte(BitReader *br) {
+    if (br->pos == br->len && br_fill(br) == 0) return -1;
+    return br->buf[br->pos++];
+}
+
+// Lee 'len' bytes seguidos; devuelve 0 si pudo leerlos todos
+static int br_get_bytes(BitReader *br, void *dst, size_t len) {
+    uint8_t *p = (uint8_t*)dst;
+    while (len > 0) {
+        if (br->pos == br->len && br_fill(br) == 0) return -1;
+        size_t n = br->len - br->pos;
+        if (n > len) n = len;
+        memcpy(p, br->buf + br->pos, n);
+        br->pos += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// # Decodificación por tabla
+// En vez de bajar por el árbol bit a bit, miramos los siguientes HUFF_TABLE_BITS bits de una vez
+// y la tabla nos dice qué símbolo(s) hay ahí y cuántos bits ocupan.
+#define HUFF_TABLE_BITS 11
+#define HUFF_TABLE_SIZE (1 << HUFF_TABLE_BITS)
+
+typedef struct {
+    uint8_t sym0;      // primer símbolo decodificado
+    uint8_t sym1;      // segundo símbolo (solo si len_total > len0)
+    uint8_t len0;      // bits del primer símbolo
+    uint8_t len_total; // bits de los dos símbolos juntos; 0 = el código es más largo que la tabla
+} DecodeEntry;
+
+// Todo lo que necesita el decodificador: la tabla rápida y cómo resolver los códigos largos
+typedef struct {
+    DecodeEntry table[HUFF_TABLE_SIZE];
+    const HuffTree *tree;      // formato antiguo: los códigos largos se terminan bajando por el árbol
+    int max_len;               // formato canónico: longitud del código más largo
+    uint32_t first_code[33];   // primer código canónico de cada longitud
+    uint16_t first_index[33];  // posición en 'sorted' del primer símbolo de cada longitud
+    uint16_t count[33];        // cuántos símbolos hay de cada longitud
+    uint8_t sorted[256];       // símbolos ordenados por (longitud, byte)
+} Decoder;
+
+// Segunda pasada sobre la tabla: si después del primer código aún quedan bits suficientes
+// para otro código completo, la entrada guarda también ese segundo símbolo.
+static void build_table_pairs(DecodeEntry table[HUFF_TABLE_SIZE]) {
+    for (uint32_t i = 0; i < HUFF_TABLE_SIZE; i++) {
+        DecodeEntry *e = &table[i];
+        if (e->len0 == 0 || e->len0 >= HUFF_TABLE_BITS) continue;
+
+        int rest = HUFF_TABLE_BITS - e->len0;
+        const DecodeEntry *next = &table[(i << e->len0) & (HUFF_TABLE_SIZE - 1)];
+        if (next->len0 != 0 && next->len0 <= rest) {
+            e->sym1 = next->sym0;
+            e->len_total = (uint8_t)(e->len0 + next->len0);
         }
-        br->buffer = tmp;
-        br->bit_count = 8;
     }
+}
 
-    // Obtener el bit más significativo del buffer
-    int bit = (br->buffer >> 7) & 1;
-    br->buffer <<= 1;
-    br->bit_count--;
+// Baja por el árbol usando los bits de 'index' (del más significativo al menos).
+// Devuelve el índice de la hoja alcanzada y cuántos bits usó, o -1 si no llegó a una hoja con 'nbits' bits.
+static int walk_bits(const HuffTree *t, uint32_t index, int nbits, int *used) {
+    int curr = t->root;
+    int i = 0;
+    while (t->nodes[curr].left >= 0 || t->nodes[curr].right >= 0) {
+        if (i == nbits) return -1;
+        int bit = (index >> (nbits - 1 - i)) & 1;
+        curr = bit ? t->nodes[curr].right : t->nodes[curr].left;
+        i++;
+    }
+    *used = i;
+    return curr;
+}
 
-    *bit_out = bit;
-    return 1;
+// Formato antiguo (.huff con tabla de frecuencias): la tabla se arma bajando por el árbol.
+// El árbol debe seguir vivo mientras se use el decodificador.
+static void decoder_init_tree(Decoder *d, const HuffTree *t) {
+    memset(d, 0, sizeof(*d));
+    d->tree = t;
+    for (uint32_t i = 0; i < HUFF_TABLE_SIZE; i++) {
+        int used;
+        int leaf = walk_bits(t, i, HUFF_TABLE_BITS, &used);
+        if (leaf >= 0) {
+            d->table[i].sym0 = t->nodes[leaf].byte;
+            d->table[i].len0 = (uint8_t)used;
+            d->table[i].len_total = (uint8_t)used;
+        }
+    }
+    build_table_pairs(d->table);
 }
 
+// Formato canónico: la tabla se arma directamente desde las longitudes, sin árbol.
+// Devuelve -1 si las longitudes no forman un código prefijo válido.
+static int decoder_init_lengths(Decoder *d, const uint8_t lengths[256]) {
+    memset(d, 0, sizeof(*d));
+
+    Code codes[256];
+    if (build_canonical_codes(lengths, codes) != 0) return -1;
+
+    // Desigualdad de Kraft: la suma de 2^-len no puede pasar de 1
+    uint64_t kraft = 0;
+    for (int i = 0; i < 256; i++) {
+        if (lengths[i] == 0) continue;
+        kraft += (uint64_t)1 << (32 - lengths[i]);
+        d->count[lengths[i]]++;
+        if (lengths[i] > d->max_len) d->max_len = lengths[i];
+    }
+    if (kraft > ((uint64_t)1 << 32)) return -1;
+
+    // Símbolos ordenados por longitud y primer código de cada longitud (para los códigos largos)
+    uint16_t idx = 0;
+    for (int len = 1; len <= 32; len++) {
+        d->first_index[len] = idx;
+        for (int i = 0; i < 256; i++) {
+            if (lengths[i] != len) continue;
+            if (idx == d->first_index[len]) d->first_code[len] = codes[i].code;
+            d->sorted[idx++] = (uint8_t)i;
+        }
+    }
 
-// Escribir header al archivo de salida
-static void write_header(int fd_out, uint64_t freq[256]) {
+    // Cada código corto ocupa todas las entradas que empiezan con sus bits
     for (int i = 0; i < 256; i++) {
-        uint64_t f = freq[i];
-        ssize_t w = write(fd_out, &f, sizeof(uint64_t));
-        if (w != sizeof(uint64_t)) {
-            perror("write header");
-            exit(1);
+        int len = lengths[i];
+        if (len == 0 || len > HUFF_TABLE_BITS) continue;
+        uint32_t start = codes[i].code << (HUFF_TABLE_BITS - len);
+        uint32_t n = 1u << (HUFF_TABLE_BITS - len);
+        for (uint32_t j = 0; j < n; j++) {
+            d->table[start + j].sym0 = (uint8_t)i;
+            d->table[start + j].len0 = (uint8_t)len;
+            d->table[start + j].len_total = (uint8_t)len;
+        }
+    }
+    build_table_pairs(d->table);
+    return 0;
+}
+
+// Código más largo que la tabla, formato antiguo: terminamos de bajar por el árbol bit a bit.
+// Devuelve el byte o -1 si se acabaron los datos.
+static int decode_slow_tree(const Decoder *d, BitReader *br) {
+    const Node *nodes = d->tree->nodes;
+    int curr = d->tree->root;
+    while (nodes[curr].left >= 0 || nodes[curr].right >= 0) {
+        if (br->nbits == 0) {
+            br_refill(br);
+            if (br->nbits == 0) return -1;
+        }
+        curr = (br->bits >> 63) ? nodes[curr].right : nodes[curr].left;
+        br_consume(br, 1);
+    }
+    return nodes[curr].byte;
+}
+
+// Código más largo que la tabla, formato canónico: probamos cada longitud en orden.
+// Los códigos de una misma longitud son consecutivos, así que basta una resta y una comparación.
+// Devuelve el byte o -1 si los bits no corresponden a ningún código.
+static int decode_slow_canonical(const Decoder *d, BitReader *br) {
+    for (int len = HUFF_TABLE_BITS + 1; len <= d->max_len; len++) {
+        uint32_t code = (uint32_t)(br->bits >> (64 - len));
+        uint32_t k = code - d->first_code[len];
+        if (k < d->count[len]) {
+            if (len > br->nbits) return -1;
+            br_consume(br, len);
+            return d->sorted[d->first_index[len] + k];
+        }
+    }
+    return -1;
+}
+
+// Decodifica 'total' bytes desde el BitReader en out_buf (de out_cap bytes).
+// Si fd_out >= 0, out_buf se escribe al archivo cada vez que se llena; con fd_out = -1
+// out_buf debe tener espacio para los 'total' bytes y el resultado queda ahí.
+// Devuelve 0 si todo bien, -1 si los datos comprimidos no alcanzan o no son válidos,
+// -2 si falló la escritura.
+static int decode_stream(const Decoder *d, BitReader *br, int fd_out,
+                         uint8_t *out_buf, size_t out_cap, uint64_t total) {
+    size_t out_len = 0;
+    uint64_t written = 0;
+    while (written < total) {
+        if (br->nbits <= 56) br_refill(br);
+
+        DecodeEntry e = d->table[br->bits >> (64 - HUFF_TABLE_BITS)];
+        if (e.len_total != 0) {
+            // Caso común: el (los) código(s) caben en la tabla
+            int take_two = e.len_total != e.len0 && total - written >= 2;
+            int used = take_two ? e.len_total : e.len0;
+            if (used > br->nbits) return -1;
+            out_buf[out_len++] = e.sym0;
+            if (take_two) out_buf[out_len++] = e.sym1;
+            br_consume(br, used);
+            written += take_two ? 2 : 1;
+        } else {
+            int b = d->tree ? decode_slow_tree(d, br) : decode_slow_canonical(d, br);
+            if (b < 0) return -1;
+            out_buf[out_len++] = (uint8_t)b;
+            written++;
+        }
+
+        // Vaciar el buffer de salida cuando ya no caben dos símbolos más
+        if (fd_out >= 0 && out_len >= out_cap - 1) {
+            if (write_all(fd_out, out_buf, out_len) != 0) return -2;
+            out_len = 0;
         }
     }
+
+    if (fd_out >= 0 && out_len > 0 && write_all(fd_out, out_buf, out_len) != 0) return -2;
+    return 0;
+}
+
+
+// # Formatos del .huff
+// Un solo bloque ("GSHUF200"), para archivos de hasta HUFF_BLOCK_SIZE bytes:
+//   magic (8 bytes) | tamaño original (varint) | longitudes de código | bits comprimidos
+// Por bloques ("GSHUF300"), para archivos más grandes:
+//   magic (8 bytes)
+//   por cada bloque: tamaño original (u32) | tamaño comprimido (u32) | longitudes | bits
+//   8 bytes en cero que marcan el final de los bloques
+//   índice: por cada bloque, tamaño original (u32) y tamaño comprimido (u32)
+//   pie: cantidad de bloques (u64) | tamaño original total (u64) | offset del índice (u64) | "GSHUFIDX"
+// Cada bloque trae su propia tabla, así que se comprime y descomprime sin depender de los demás.
+// Los enteros de tamaño fijo van en little-endian.
+//
+// Las longitudes se guardan de la forma más corta de estas dos:
+//   0 = lista: cantidad-1 (1 byte) y luego pares (byte, longitud)
+//   1 = mapa: 32 bytes con un bit por símbolo presente y luego la longitud de cada uno
+// Si el archivo está vacío no hay tabla de longitudes.
+// El formato antiguo (sin magic) empieza directamente con las 256 frecuencias de 8 bytes.
+static const char MAGIC_HUFF[8] = "GSHUF200";
+static const char MAGIC_HUFF_BLOCKS[8] = "GSHUF300";
+static const char MAGIC_HUFF_INDEX[8] = "GSHUFIDX";
+
+// Tope de seguridad al leer: ningún bloque válido declara más que esto
+#define HUFF_MAX_BLOCK_SIZE (1 << 26)
+
+static void store_le32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
 }
 
-// Leer header del archivo comprimido
-static void read_header(int fd_in, uint64_t freq[256]) {
+static void store_le64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t load_le32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint64_t load_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// Entero sin signo en base 128: 7 bits por byte, el bit alto indica que sigue otro byte
+static void bw_put_varint(BitWriter *bw, uint64_t v) {
+    uint8_t tmp[10];
+    int n = 0;
+    do {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        tmp[n++] = b | (v ? 0x80 : 0);
+    } while (v);
+    bw_put_bytes(bw, tmp, n);
+}
+
+static int br_get_varint(BitReader *br, uint64_t *out) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = br_get_byte(br);
+        if (c < 0) return -1;
+        v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Escribe la tabla de longitudes de código (al menos un símbolo presente)
+static void write_lengths(BitWriter *bw, const uint8_t lengths[256]) {
+    int n = 0;
     for (int i = 0; i < 256; i++) {
-        uint64_t f;
-        ssize_t r = read(fd_in, &f, sizeof(uint64_t));
-        if (r != sizeof(uint64_t)) {
-            perror("read header");
-            exit(1);
+        if (lengths[i]) n++;
+    }
+
+    uint8_t tmp[1 + 32 + 256 * 2];
+    size_t len = 0;
+    if (2 * n < 32 + n) {
+        tmp[len++] = 0;
+        tmp[len++] = (uint8_t)(n - 1);
+        for (int i = 0; i < 256; i++) {
+            if (!lengths[i]) continue;
+            tmp[len++] = (uint8_t)i;
+            tmp[len++] = lengths[i];
+        }
+    } else {
+        tmp[len++] = 1;
+        memset(tmp + len, 0, 32);
+        for (int i = 0; i < 256; i++) {
+            if (lengths[i]) tmp[len + i / 8] |= (uint8_t)(1 << (i % 8));
+        }
+        len += 32;
+        for (int i = 0; i < 256; i++) {
+            if (lengths[i]) tmp[len++] = lengths[i];
         }
-        freq[i] = f;
     }
+    bw_put_bytes(bw, tmp, len);
 }
 
+// Leer la tabla de longitudes. Devuelve 0 si todo bien, -1 si está incompleta.
+static int read_lengths(BitReader *br, uint8_t lengths[256]) {
+    memset(lengths, 0, 256);
+    int mode = br_get_byte(br);
+    if (mode == 0) {
+        int n = br_get_byte(br);
+        if (n < 0) return -1;
+        for (int i = 0; i <= n; i++) {
+            int sym = br_get_byte(br);
+            int len = br_get_byte(br);
+            if (sym < 0 || len < 0) return -1;
+            lengths[sym] = (uint8_t)len;
+        }
+        return 0;
+    }
+    if (mode == 1) {
+        uint8_t map[32];
+        if (br_get_bytes(br, map, sizeof(map)) != 0) return -1;
+        for (int i = 0; i < 256; i++) {
+            if (!(map[i / 8] & (1 << (i % 8)))) continue;
+            int len = br_get_byte(br);
+            if (len < 0) return -1;
+            lengths[i] = (uint8_t)len;
+        }
+        return 0;
+    }
+    return -1;
+}
 
-// Devuelve 0 si todo bien, -1 si error al abrir archivo
-int compress_file(const char *input_path, const char *output_path) {
-    // 1. Abrir archivo de entrada con open()
-    int fd_in = open(input_path, O_RDONLY);
-    if (fd_in < 0) {
-        perror("open input");
-        return -1;
+// # Histograma de bytes
+// Con una sola tabla, una racha del mismo byte hace que cada freq[b]++ espere a que termine el
+// anterior sobre la misma posición de memoria. Con 4 sub-tablas los bytes consecutivos caen en
+// tablas distintas y los incrementos se pueden solapar; al final se suman las 4 tablas.
+// Se compila una versión AVX2 y otra genérica y el cargador elige la que soporta la CPU
+// (target_clones), lo que también vectoriza la suma final de las tablas.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define HUFF_TARGET_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define HUFF_TARGET_CLONES
+#endif
+
+// Por debajo de esto no vale la pena limpiar y sumar las sub-tablas
+#define HUFF_HISTOGRAM_SMALL 1024
+// Contadores de 32 bits: se vuelcan a freq antes de que puedan desbordarse
+#define HUFF_HISTOGRAM_CHUNK ((size_t)1 << 30)
+
+HUFF_TARGET_CLONES
+static void histogram_chunk(const uint8_t *data, size_t len, uint64_t freq[256]) {
+    uint32_t t[4][256];
+    memset(t, 0, sizeof(t));
+
+    // De 8 en 8 bytes: una lectura de 64 bits y cada byte a una sub-tabla distinta
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        t[0][(uint8_t)(w)]++;
+        t[1][(uint8_t)(w >> 8)]++;
+        t[2][(uint8_t)(w >> 16)]++;
+        t[3][(uint8_t)(w >> 24)]++;
+        t[0][(uint8_t)(w >> 32)]++;
+        t[1][(uint8_t)(w >> 40)]++;
+        t[2][(uint8_t)(w >> 48)]++;
+        t[3][(uint8_t)(w >> 56)]++;
+    }
+    for (; i < len; i++) {
+        t[0][data[i]]++;
     }
 
-    // 2. Contar frecuencias de cada byte (0..255)
+    for (int b = 0; b < 256; b++) {
+        freq[b] += (uint64_t)t[0][b] + t[1][b] + t[2][b] + t[3][b];
+    }
+}
+
+void huffman_histogram(const uint8_t *data, size_t len, uint64_t freq[256]) {
+    if (len < HUFF_HISTOGRAM_SMALL) {
+        for (size_t i = 0; i < len; i++) {
+            freq[ data[i] ]++;
+        }
+        return;
+    }
+    while (len > 0) {
+        size_t n = len < HUFF_HISTOGRAM_CHUNK ? len : HUFF_HISTOGRAM_CHUNK;
+        histogram_chunk(data, n, freq);
+        data += n;
+        len -= n;
+    }
+}
+
+uint64_t huffman_estimate_bits(const uint64_t freq[256]) {
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++) total += freq[i];
+    if (total == 0) return 0;
+    uint8_t lengths[256];
+    build_lengths(freq, lengths, HUFF_MAX_CODE_LEN);
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++) bits += freq[i] * lengths[i];
+    return bits;
+}
+
+// Comprime src[0..len) (len > 0): tabla de longitudes y luego los bits, alineados a byte al final
+static void encode_block(BitWriter *bw, const uint8_t *src, size_t len) {
+    // 1. Contar frecuencias de cada byte (0..255)
     uint64_t freq[256];
     memset(freq, 0, sizeof(freq));
+    huffman_histogram(src, len, freq);
+
+    // 2. Longitudes limitadas a HUFF_MAX_CODE_LEN bits y sus códigos canónicos
+    uint8_t lengths[256];
+    Code codes[256];
+    build_lengths(freq, lengths, HUFF_MAX_CODE_LEN);
+    build_canonical_codes(lengths, codes);
+
+    // 3. Escribir la tabla y los bits comprimidos
+    write_lengths(bw, lengths);
+    for (size_t i = 0; i < len; i++) {
+        bw_write_code(bw, codes[src[i]].code, codes[src[i]].length);
+    }
+    bw_align(bw);
+}
+
+// Descomprime un bloque que está completo en memoria (tabla + bits) en dst[0..raw_len).
+// Devuelve 0 si todo bien, -1 si los datos no son válidos.
+static int decode_block(Decoder *dec, const uint8_t *src, size_t comp_len, uint8_t *dst, size_t raw_len) {
+    BitReader br;
+    uint8_t lengths[256];
+    br_init_mem(&br, src, comp_len);
+    if (read_lengths(&br, lengths) != 0 || decoder_init_lengths(dec, lengths) != 0) return -1;
+    return decode_stream(dec, &br, -1, dst, raw_len, raw_len);
+}
+
+// Archivo pequeño: formato de un solo bloque. Si la entrada está mapeada (map != NULL) se comprime
+// directo desde el mapa; si no, se lee completa a memoria con una sola lectura.
+static int compress_single(int fd_in, BitWriter *out, size_t size, const uint8_t *map) {
+    uint8_t *buf = map ? NULL : malloc(size > 0 ? size : 1);
+    if (!map && !buf) {
+        perror("malloc");
+        return -1;
+    }
+
+    const uint8_t *src = map;
+    ssize_t n = (ssize_t)size;
+    if (!map) {
+        n = read_full(fd_in, buf, size);
+        src = buf;
+    }
+    if (n < 0) {
+        perror("read input");
+        free(buf);
+        return -1;
+    }
+
+    bw_put_bytes(out, MAGIC_HUFF, sizeof(MAGIC_HUFF));
+    bw_put_varint(out, (uint64_t)n);
+    if (n > 0) {
+        encode_block(out, src, (size_t)n);
+    }
+
+    free(buf);
+    return out->error ? -1 : 0;
+}
+
+// Un bloque del formato por bloques: tamaño original u32, tamaño comprimido u32 y el bloque
+// comprimido. Se escribe al final de bw, que debe estar alineado a byte.
+static void encode_block_record(BitWriter *bw, const uint8_t *src, size_t raw) {
+    uint8_t hdr[8] = {0};
+    size_t start = bw->len;
+    bw_put_bytes(bw, hdr, sizeof(hdr));
+    encode_block(bw, src, raw);
+    if (bw->error) return;
+    store_le32(bw->buf + start, (uint32_t)raw);
+    store_le32(bw->buf + start + 4, (uint32_t)(bw->len - start - sizeof(hdr)));
+}
+
+// Lo que va después del último bloque: la marca de fin (8 ceros), el índice (por bloque, tamaño
+// original y comprimido, u32 cada uno) y el pie. index tiene 2 * nblocks valores.
+// Devuelve la cola en memoria nueva (*len bytes) o NULL si no hay memoria.
+static uint8_t* build_blocks_tail(const uint32_t *index, uint32_t nblocks, size_t *len) {
+    uint64_t offset = sizeof(MAGIC_HUFF_BLOCKS);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < nblocks; i++) {
+        offset += 8 + index[2 * i + 1];
+        total += index[2 * i];
+    }
+    offset += 8;
+
+    size_t idx_len = (size_t)nblocks * 8;
+    uint8_t *tail = malloc(8 + idx_len + 32);
+    if (!tail) return NULL;
+    memset(tail, 0, 8);
+    for (uint32_t i = 0; i < nblocks; i++) {
+        store_le32(tail + 8 + 8 * i, index[2 * i]);
+        store_le32(tail + 8 + 8 * i + 4, index[2 * i + 1]);
+    }
+    uint8_t *foot = tail + 8 + idx_len;
+    store_le64(foot, nblocks);
+    store_le64(foot + 8, total);
+    store_le64(foot + 16, offset);
+    memcpy(foot + 24, MAGIC_HUFF_INDEX, 8);
+    *len = 8 + idx_len + 32;
+    return tail;
+}
+
+// Estado compartido por los hilos que comprimen los bloques de un archivo
+typedef struct {
+    int fd_in;
+    BitWriter *out;         // salida (archivo o memoria); solo se usa con el candado tomado
+    int stream;             // 1 = entrada sin posiciones (pipe, stdin): se lee en orden, sin pread
+    int eof;                // (stream) ya no hay más bloques por leer
+    uint64_t size;          // tamaño del archivo de entrada (si no es stream)
+    const uint8_t *map;     // archivo de entrada mapeado en memoria (NULL = leer con pread/read)
+    uint32_t nblocks;       // bloques en total (si no es stream, se conoce desde el inicio)
+    uint32_t next_block;    // siguiente bloque por comprimir
+    uint32_t next_write;    // siguiente bloque por escribir: se escriben en orden
+    uint32_t *index;        // por bloque: tamaño original y tamaño comprimido
+    uint32_t index_cap;     // bloques que caben en index
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;    // avisa cuando cambia next_write o hubo un error
+} BlockCompressJob;
+
+// Cada hilo toma el siguiente bloque, lo comprime en memoria y espera su turno para escribirlo.
+// La memoria usada es de a lo sumo un bloque por hilo, sin importar el tamaño de la entrada.
+static void* block_compress_worker(void *arg) {
+    BlockCompressJob *job = (BlockCompressJob*)arg;
+    uint8_t *buf = job->map ? NULL : malloc(HUFF_BLOCK_SIZE);
+    BitWriter bw;
+    bw_init_mem(&bw, HUFF_BLOCK_SIZE + HUFF_BLOCK_SIZE / 2);
+    if ((!job->map && !buf) || bw.error) {
+        perror("malloc");
+        pthread_mutex_lock(&job->lock);
+        job->error = 1;
+        pthread_cond_broadcast(&job->turn);
+        pthread_mutex_unlock(&job->lock);
+        free(buf);
+        free(bw.buf);
+        return NULL;
+    }
 
-    uint8_t buffer[4096];
     while (1) {
-        ssize_t r = read(fd_in, buffer, sizeof(buffer));
-        if (r < 0) {
-            perror("read input");
-            close(fd_in);
+        // 1. Tomar el siguiente bloque. En un stream el bloque se lee aquí mismo, con el candado,
+        //    para que los bloques salgan en el orden en que llegan.
+        const uint8_t *src = buf;
+        size_t raw = 0;
+        int ok = 1;
+        pthread_mutex_lock(&job->lock);
+        uint32_t idx = job->next_block;
+        int stop = job->error || job->eof || (!job->stream && idx >= job->nblocks);
+        if (!stop && job->stream) {
+            ssize_t n = read_full(job->fd_in, buf, HUFF_BLOCK_SIZE);
+            if (n < 0) {
+                perror("read input");
+                job->error = 1;
+                pthread_cond_broadcast(&job->turn);
+            }
+            if (n < HUFF_BLOCK_SIZE) job->eof = 1;
+            if (n <= 0) stop = 1;
+            else raw = (size_t)n;
+        }
+        if (!stop) job->next_block++;
+        pthread_mutex_unlock(&job->lock);
+        if (stop) break;
+
+        // 2. Ubicar el bloque (en el mapa, o leyéndolo si es archivo) y comprimirlo con su propia tabla
+        if (!job->stream) {
+            uint64_t off = (uint64_t)idx * HUFF_BLOCK_SIZE;
+            raw = job->size - off < HUFF_BLOCK_SIZE ? (size_t)(job->size - off) : HUFF_BLOCK_SIZE;
+            if (job->map) {
+                src = job->map + off;
+            } else {
+                ok = pread_all(job->fd_in, buf, raw, (off_t)off) == 0;
+                if (!ok) perror("read input");
+            }
+        }
+
+        bw.len = 0;
+        bw.error = 0;
+        if (ok) encode_block_record(&bw, src, raw);
+        if (bw.error) {
+            perror("malloc");
+            ok = 0;
+        }
+        uint32_t comp = ok ? (uint32_t)(bw.len - 8) : 0;
+
+        // 3. Esperar a que se hayan escrito todos los bloques anteriores
+        pthread_mutex_lock(&job->lock);
+        while (!job->error && job->next_write != idx) {
+            pthread_cond_wait(&job->turn, &job->lock);
+        }
+        if (ok && !job->error && idx >= job->index_cap) {
+            uint32_t cap = job->index_cap * 2 + 64;
+            uint32_t *bigger = realloc(job->index, sizeof(uint32_t) * 2 * cap);
+            if (!bigger) {
+                perror("malloc");
+                ok = 0;
+            } else {
+                job->index = bigger;
+                job->index_cap = cap;
+            }
+        }
+        if (ok && !job->error) {
+            bw_write_raw(job->out, bw.buf, bw.len);
+            if (job->out->error) {
+                ok = 0;
+            } else {
+                job->index[2 * idx] = (uint32_t)raw;
+                job->index[2 * idx + 1] = comp;
+            }
+        }
+        if (!ok) job->error = 1;
+        job->next_write++;
+        pthread_cond_broadcast(&job->turn);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    free(buf);
+    free(bw.buf);
+    return NULL;
+}
+
+// Bloques de HUFF_BLOCK_SIZE comprimidos en paralelo y escritos en orden, seguidos del índice
+// de bloques y el pie. Con stream = 1 la entrada se lee una sola vez de principio a fin y la
+// salida solo se escribe hacia adelante, así que ambas pueden ser pipes.
+static int compress_blocks(int fd_in, BitWriter *out, uint64_t size, const uint8_t *map,
+                           int stream, int num_threads) {
+    BlockCompressJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd_in = fd_in;
+    job.out = out;
+    job.stream = stream;
+    job.size = size;
+    job.map = map;
+    if (!stream) {
+        job.nblocks = (uint32_t)((size + HUFF_BLOCK_SIZE - 1) / HUFF_BLOCK_SIZE);
+        job.index_cap = job.nblocks;
+        job.index = malloc(sizeof(uint32_t) * 2 * job.nblocks);
+        if (!job.index) {
+            perror("malloc");
             return -1;
         }
-        if (r == 0) {
-            // EOF
-            break;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.turn, NULL);
+
+    bw_put_bytes(out, MAGIC_HUFF_BLOCKS, sizeof(MAGIC_HUFF_BLOCKS));
+    if (out->error) job.error = 1;
+
+    int nt = num_threads;
+    if (!stream && nt > (int)job.nblocks) nt = (int)job.nblocks;
+    if (nt < 1) nt = 1;
+
+    if (!job.error) run_threads(block_compress_worker, &job, nt);
+    if (stream) job.nblocks = job.next_block;
+
+    // Marca de fin, índice y pie
+    if (!job.error) {
+        size_t tail_len;
+        uint8_t *tail = build_blocks_tail(job.index, job.nblocks, &tail_len);
+        if (!tail) {
+            perror("malloc");
+            job.error = 1;
+        } else {
+            bw_write_raw(out, tail, tail_len);
+            if (out->error) job.error = 1;
+            free(tail);
+        }
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.turn);
+    free(job.index);
+    return job.error ? -1 : 0;
+}
+
+// Comprime la entrada ya abierta (con su fstat) hacia 'out', que puede ser un archivo o memoria.
+// Hasta un bloque: formato de un solo bloque. Más grande: bloques en paralelo.
+// Si la entrada no es un archivo (pipe, stdin, socket) no sabemos su tamaño ni podemos
+// volver atrás: se comprime por bloques a medida que llega, en una sola pasada.
+// Un archivo regular se mapea en memoria: las dos pasadas (frecuencias y códigos) leen
+// directo de las páginas del caché del sistema, sin copiarlas a un buffer. Si no se
+// puede mapear, se usa la lectura normal.
+static int compress_fd(int fd_in, const struct stat *st, BitWriter *out, int num_threads) {
+    int status;
+    if (!S_ISREG(st->st_mode)) {
+        status = compress_blocks(fd_in, out, 0, NULL, 1, num_threads);
+    } else {
+        size_t size = (size_t)st->st_size;
+        uint8_t *map = NULL;
+        if (size > 0) {
+            map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd_in, 0);
+            if (map == MAP_FAILED) {
+                map = NULL;
+            } else {
+                madvise(map, size, MADV_SEQUENTIAL);
+            }
         }
-        for (ssize_t i = 0; i < r; i++) {
-            freq[ buffer[i] ]++;
+
+        if (size <= HUFF_BLOCK_SIZE) {
+            status = compress_single(fd_in, out, size, map);
+        } else {
+            status = compress_blocks(fd_in, out, size, map, 0, num_threads);
         }
+        if (map) munmap(map, size);
     }
+    bw_flush(out);
+    return status == 0 && !out->error ? 0 : -1;
+}
 
-    // 3. Construir árbol Huffman
-    Node *root = build_huffman_tree(freq);
+int compress_fd_mt(int fd_in, int fd_out, int num_threads) {
+    struct stat st;
+    if (fstat(fd_in, &st) != 0) {
+        perror("fstat input");
+        return -1;
+    }
+    uint8_t *out_buf = malloc(HUFF_IO_BUF_SIZE);
+    if (!out_buf) {
+        perror("malloc");
+        return -1;
+    }
+    BitWriter out;
+    bw_init(&out, fd_out, out_buf);
+    int status = compress_fd(fd_in, &st, &out, num_threads);
+    free(out_buf);
+    return status;
+}
 
-    // 4. Abrir archivo de salida
-    int fd_out = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+// Devuelve 0 si todo bien, -1 si error
+int compress_file_mt(const char *input_path, const char *output_path, int num_threads) {
+    // 1. Abrir archivo de entrada con open()
+    int fd_in = open_input(input_path);
+    if (fd_in < 0) {
+        perror("open input");
+        return -1;
+    }
+
+    // 2. Abrir archivo de salida
+    int fd_out = open_output(output_path);
     if (fd_out < 0) {
         perror("open output");
         close(fd_in);
-        free_tree(root);
         return -1;
     }
 
-    // 5. Escribir header (tabla de frecuencias)
-    write_header(fd_out, freq);
+    // 3. Comprimir
+    int status = compress_fd_mt(fd_in, fd_out, num_threads);
+    close(fd_in);
+    close(fd_out);
+    return status;
+}
+
+int compress_file_to_memory(const char *input_path, uint8_t **out, size_t *out_len) {
+    return compress_file_to_memory_mt(input_path, out, out_len, 1);
+}
 
-    // 6. Si el archivo estaba vacío, terminamos
-    if (root == NULL) {
+int compress_file_to_memory_mt(const char *input_path, uint8_t **out, size_t *out_len, int num_threads) {
+    *out = NULL;
+    *out_len = 0;
+    int fd_in = open_input(input_path);
+    if (fd_in < 0) {
+        perror("open input");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd_in, &st) != 0) {
+        perror("fstat input");
         close(fd_in);
-        close(fd_out);
-        return 0;
+        return -1;
     }
 
-    // 7. Generar tabla de códigos Huffman
-    Code codes[256];
-    build_codes(root, codes);
-
-    // 8. Regresar al inicio del archivo original para volverlo a leer
-    off_t off = lseek(fd_in, 0, SEEK_SET);
-    if (off == (off_t)-1) {
-        perror("lseek");
+    // Capacidad inicial: la mitad de la entrada suele alcanzar para texto; si no, el buffer crece
+    BitWriter bw;
+    size_t guess = S_ISREG(st.st_mode) ? (size_t)st.st_size / 2 : 0;
+    bw_init_mem(&bw, guess + 4096);
+    if (bw.error) {
+        perror("malloc");
         close(fd_in);
-        close(fd_out);
-        free_tree(root);
         return -1;
     }
+    int status = compress_fd(fd_in, &st, &bw, num_threads);
+    close(fd_in);
+    if (status != 0) {
+        free(bw.buf);
+        return -1;
+    }
+    *out = bw.buf;
+    *out_len = bw.len;
+    return 0;
+}
 
-    // 9. Escribir los bits comprimidos
+void huffman_blocks_head(uint8_t head[8]) {
+    memcpy(head, MAGIC_HUFF_BLOCKS, sizeof(MAGIC_HUFF_BLOCKS));
+}
+
+int huffman_encode_block(const uint8_t *src, size_t len, uint8_t **out, size_t *out_len) {
+    *out = NULL;
+    *out_len = 0;
+    if (len == 0 || len > HUFF_BLOCK_SIZE) return -1;
     BitWriter bw;
-    bw_init(&bw, fd_out);
+    bw_init_mem(&bw, len + len / 2 + 64);
+    if (!bw.error) encode_block_record(&bw, src, len);
+    if (bw.error) {
+        perror("malloc");
+        free(bw.buf);
+        return -1;
+    }
+    *out = bw.buf;
+    *out_len = bw.len;
+    return 0;
+}
+
+int huffman_blocks_tail(uint8_t *const *blocks, uint32_t nblocks, uint8_t **out, size_t *out_len) {
+    uint32_t *index = malloc(sizeof(uint32_t) * 2 * (nblocks ? nblocks : 1));
+    if (!index) {
+        perror("malloc");
+        return -1;
+    }
+    for (uint32_t i = 0; i < nblocks; i++) {
+        index[2 * i] = load_le32(blocks[i]);
+        index[2 * i + 1] = load_le32(blocks[i] + 4);
+    }
+    *out = build_blocks_tail(index, nblocks, out_len);
+    free(index);
+    if (!*out) {
+        perror("malloc");
+        return -1;
+    }
+    return 0;
+}
+
+// Devuelve 0 si todo bien, -1 si error al abrir archivo
+int compress_file(const char *input_path, const char *output_path) {
+    return compress_file_mt(input_path, output_path, 1);
+}
+
+// Formato por bloques, leído de principio a fin: cada bloque se carga completo y se decodifica
+// en memoria. Se detiene en la marca de fin; el índice y el pie no hacen falta aquí.
+static int decompress_blocks_seq(BitReader *br, int fd_out, Decoder *dec) {
+    uint8_t *comp_buf = NULL;
+    uint8_t *raw_buf = NULL;
+    size_t comp_cap = 0, raw_cap = 0;
+    int status = 0;
 
     while (1) {
-        ssize_t r = read(fd_in, buffer, sizeof(buffer));
-        if (r < 0) {
-            perror("read input 2");
-            close(fd_in);
-            close(fd_out);
-            free_tree(root);
-            return -1;
+        uint8_t hdr[8];
+        if (br_get_bytes(br, hdr, sizeof(hdr)) != 0) {
+            status = -1;
+            break;
+        }
+        uint32_t raw = load_le32(hdr);
+        uint32_t comp = load_le32(hdr + 4);
+        if (raw == 0) break;
+        if (raw > HUFF_MAX_BLOCK_SIZE || comp > 2 * HUFF_MAX_BLOCK_SIZE) {
+            status = -1;
+            break;
+        }
+
+        if (comp > comp_cap || raw > raw_cap) {
+            free(comp_buf);
+            free(raw_buf);
+            comp_cap = comp > comp_cap ? comp : comp_cap;
+            raw_cap = raw > raw_cap ? raw : raw_cap;
+            comp_buf = malloc(comp_cap);
+            raw_buf = malloc(raw_cap);
+            if (!comp_buf || !raw_buf) {
+                perror("malloc");
+                status = -3;
+                break;
+            }
+        }
+
+        if (br_get_bytes(br, comp_buf, comp) != 0
+            || decode_block(dec, comp_buf, comp, raw_buf, raw) != 0) {
+            status = -1;
+            break;
+        }
+        if (write_all(fd_out, raw_buf, raw) != 0) {
+            status = -2;
+            break;
         }
-        if (r == 0) break; // EOF
+    }
+
+    free(comp_buf);
+    free(raw_buf);
+    return status;
+}
 
-        for (ssize_t i = 0; i < r; i++) {
-            uint8_t b = buffer[i];
-            bw_write_code(&bw, codes[b].code, codes[b].length);
+// Descomprime lo que entrega br de principio a fin (sirve para todos los formatos),
+// ya sea un archivo o un buffer en memoria. Si fd_out es -1, output_path se abre recién
+// después de leer el header; si no, se escribe en fd_out, que ya viene abierto y se cierra
+// al terminar. Devuelve 0 si todo bien, -1 si error.
+static int decompress_reader(BitReader *br, const char *output_path, int fd_out) {
+    uint8_t *out_buf = malloc(HUFF_IO_BUF_SIZE);
+    Decoder *dec = malloc(sizeof(Decoder));
+    if (!out_buf || !dec) {
+        perror("malloc");
+        free(out_buf);
+        free(dec);
+        if (fd_out >= 0) close(fd_out);
+        return -1;
+    }
+
+    // 1. Leer header y preparar la tabla de decodificación
+    int status = 0;
+    int blocks = 0;
+    uint64_t total_bytes = 0;
+    HuffTree tree;
+    char magic[8];
+    if (br_get_bytes(br, magic, sizeof(magic)) != 0) {
+        status = -1;
+    } else if (memcmp(magic, MAGIC_HUFF_BLOCKS, sizeof(magic)) == 0) {
+        // Formato por bloques: cada bloque trae su tabla
+        blocks = 1;
+    } else if (memcmp(magic, MAGIC_HUFF, sizeof(magic)) == 0) {
+        // Un solo bloque: tamaño original y longitudes de código
+        uint8_t lengths[256];
+        if (br_get_varint(br, &total_bytes) != 0
+            || (total_bytes > 0 && (read_lengths(br, lengths) != 0
+                                    || decoder_init_lengths(dec, lengths) != 0))) {
+            status = -1;
+        }
+    } else {
+        // Formato antiguo: 256 frecuencias; los primeros 8 bytes ya leídos son freq[0]
+        uint64_t freq[256];
+        memcpy(&freq[0], magic, sizeof(uint64_t));
+        if (br_get_bytes(br, &freq[1], 255 * sizeof(uint64_t)) != 0) {
+            status = -1;
+        } else {
+            // Reconstruir el mismo árbol Huffman; el total es la suma de las frecuencias
+            build_huffman_tree(&tree, freq);
+            for (int i = 0; i < 256; i++) {
+                total_bytes += freq[i];
+            }
+            if (tree.root >= 0) decoder_init_tree(dec, &tree);
         }
     }
+    if (status != 0) {
+        fprintf(stderr, "Error: header del archivo comprimido inválido\n");
+        free(out_buf);
+        free(dec);
+        if (fd_out >= 0) close(fd_out);
+        return -1;
+    }
 
-    bw_flush(&bw);
-    close(fd_in);
+    // 2. Abrir archivo de salida para escribir bytes restaurados
+    if (fd_out < 0) fd_out = open_output(output_path);
+    if (fd_out < 0) {
+        perror("open output");
+        free(out_buf);
+        free(dec);
+        return -1;
+    }
+
+    // 3. Decodificar con la tabla: cada consulta entrega uno o dos símbolos
+    if (blocks) {
+        status = decompress_blocks_seq(br, fd_out, dec);
+    } else if (total_bytes > 0) {
+        status = decode_stream(dec, br, fd_out, out_buf, HUFF_IO_BUF_SIZE, total_bytes);
+    }
+    if (status == -1 && !br->error) {
+        fprintf(stderr, "Error: datos comprimidos insuficientes\n");
+    } else if (status == -2) {
+        perror("write output");
+    }
+
+    free(out_buf);
+    free(dec);
     close(fd_out);
-    free_tree(root);
 
-    return 0;
+    return status == 0 ? 0 : -1;
 }
 
-// Devuelve 0 si todo bien, -1 si error al abrir archivo
-int decompress_file(const char *input_path, const char *output_path) {
-    // 1. Abrir archivo .huff para lectura
-    int fd_in = open(input_path, O_RDONLY);
-    if (fd_in < 0) {
-        perror("open input");
+// Descomprime leyendo fd_in de principio a fin, hacia fd_out o hacia output_path si fd_out
+// es -1. Cierra fd_in al terminar. Devuelve 0 si todo bien, -1 si error.
+static int decompress_into(int fd_in, const char *output_path, int fd_out) {
+    uint8_t *in_buf = malloc(HUFF_IO_BUF_SIZE);
+    if (!in_buf) {
+        perror("malloc");
+        close(fd_in);
+        if (fd_out >= 0) close(fd_out);
         return -1;
     }
+    BitReader br;
+    br_init(&br, fd_in, in_buf);
+    int status = decompress_reader(&br, output_path, fd_out);
+    free(in_buf);
+    close(fd_in);
+    return status;
+}
 
-    // 2. Leer header (frecuencias) desde el archivo comprimido
-    uint64_t freq[256];
-    read_header(fd_in, freq);
+int decompress_fd(int fd_in, const char *output_path) {
+    return decompress_into(fd_in, output_path, -1);
+}
 
-    // 3. Reconstruir el mismo árbol Huffman
-    Node *root = build_huffman_tree(freq);
+int decompress_memory(const uint8_t *src, size_t len, const char *output_path) {
+    BitReader br;
+    br_init_mem(&br, src, len);
+    return decompress_reader(&br, output_path, -1);
+}
 
-    // 4. Calcular cuántos bytes originales debemos recrear, es decir, la suma de todas las frecunecias (Nodo raíz)
-    uint64_t total_bytes = 0;
+// # Tabla compartida
+// Son las mismas longitudes canónicas de un bloque, solo que se arman una vez para muchos
+// archivos: el codificador usa codes y el decodificador (de solo lectura) dec.
+struct HuffShared {
+    uint8_t lengths[256];
+    Code codes[256];
+    Decoder dec;
+};
+
+HuffShared* huffman_shared_build(const uint64_t freq[256]) {
+    HuffShared *sh = malloc(sizeof(HuffShared));
+    if (!sh) return NULL;
+    // Los bytes que no aparecen cuentan como vistos una vez: reciben un código largo
+    uint64_t f[256];
+    for (int i = 0; i < 256; i++) f[i] = freq[i] ? freq[i] : 1;
+    build_lengths(f, sh->lengths, HUFF_MAX_CODE_LEN);
+    if (build_canonical_codes(sh->lengths, sh->codes) != 0 || decoder_init_lengths(&sh->dec, sh->lengths) != 0) {
+        free(sh);
+        return NULL;
+    }
+    return sh;
+}
+
+int huffman_shared_save(const HuffShared *sh, uint8_t **out, size_t *out_len) {
+    BitWriter bw;
+    bw_init_mem(&bw, 1 + 32 + 256);
+    if (!bw.error) write_lengths(&bw, sh->lengths);
+    if (bw.error) {
+        free(bw.buf);
+        return -1;
+    }
+    *out = bw.buf;
+    *out_len = bw.len;
+    return 0;
+}
+
+HuffShared* huffman_shared_load(const uint8_t *src, size_t len) {
+    HuffShared *sh = malloc(sizeof(HuffShared));
+    if (!sh) return NULL;
+    BitReader br;
+    br_init_mem(&br, src, len);
+    if (read_lengths(&br, sh->lengths) != 0 || build_canonical_codes(sh->lengths, sh->codes) != 0
+        || decoder_init_lengths(&sh->dec, sh->lengths) != 0) {
+        free(sh);
+        return NULL;
+    }
+    // Una tabla compartida siempre tiene código para todos los bytes (se usa para comprimir
+    // archivos que no estaban cuando se armó, con --update)
     for (int i = 0; i < 256; i++) {
-        total_bytes += freq[i];
+        if (sh->lengths[i] == 0) {
+            free(sh);
+            return NULL;
+        }
+    }
+    return sh;
+}
+
+void huffman_shared_free(HuffShared *sh) {
+    free(sh);
+}
+
+uint64_t huffman_shared_estimate_bits(const HuffShared *sh, const uint64_t freq[256]) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++) bits += freq[i] * sh->lengths[i];
+    return bits;
+}
+
+int huffman_shared_encode(const HuffShared *sh, const uint8_t *src, size_t len, uint8_t **out, size_t *out_len) {
+    BitWriter bw;
+    bw_init_mem(&bw, len / 2 + 64);
+    if (!bw.error) {
+        bw_put_varint(&bw, len);
+        for (size_t i = 0; i < len; i++) {
+            bw_write_code(&bw, sh->codes[src[i]].code, sh->codes[src[i]].length);
+        }
+        bw_align(&bw);
+    }
+    if (bw.error) {
+        perror("malloc");
+        free(bw.buf);
+        return -1;
     }
+    *out = bw.buf;
+    *out_len = bw.len;
+    return 0;
+}
 
-    // 5. Abrir archivo de salida para escribir bytes restaurados
-    int fd_out = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+int huffman_shared_decode(const HuffShared *sh, const uint8_t *src, size_t len, const char *output_path) {
+    BitReader br;
+    uint64_t total;
+    br_init_mem(&br, src, len);
+    if (br_get_varint(&br, &total) != 0) {
+        fprintf(stderr, "Error: header del archivo comprimido inválido\n");
+        return -1;
+    }
+    uint8_t *out_buf = malloc(HUFF_IO_BUF_SIZE);
+    if (!out_buf) {
+        perror("malloc");
+        return -1;
+    }
+    int fd_out = open_output(output_path);
     if (fd_out < 0) {
         perror("open output");
-        close(fd_in);
-        free_tree(root);
+        free(out_buf);
         return -1;
     }
+    int status = total > 0 ? decode_stream(&sh->dec, &br, fd_out, out_buf, HUFF_IO_BUF_SIZE, total) : 0;
+    if (status == -1) fprintf(stderr, "Error: datos comprimidos insuficientes\n");
+    else if (status == -2) perror("write output");
+    free(out_buf);
+    close(fd_out);
+    return status == 0 ? 0 : -1;
+}
 
-    // 6. Si no había datos en el original, terminamos
-    if (root == NULL || total_bytes == 0) {
-        close(fd_in);
-        close(fd_out);
-        free_tree(root);
-        return 0;
+// Ubicación de un bloque dentro del .huff y dentro del archivo original
+typedef struct {
+    uint64_t comp_off;   // offset en el .huff de los datos del bloque (después de sus 8 bytes de header)
+    uint64_t raw_off;    // offset en el archivo original
+    uint32_t comp_len;
+    uint32_t raw_len;
+} BlockInfo;
+
+// Lee el pie y el índice de un .huff por bloques y calcula dónde está cada bloque.
+// Devuelve 0 si todo bien, -1 si el archivo no es por bloques o el índice no es coherente.
+static int read_block_index(int fd, BlockInfo **out_blocks, uint32_t *out_nblocks, uint64_t *out_total) {
+    struct stat st;
+    uint8_t magic[8], foot[32];
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < sizeof(magic) + 8 + sizeof(foot)) return -1;
+    if (pread_all(fd, magic, sizeof(magic), 0) != 0
+        || memcmp(magic, MAGIC_HUFF_BLOCKS, sizeof(magic)) != 0
+        || pread_all(fd, foot, sizeof(foot), (off_t)(size - sizeof(foot))) != 0
+        || memcmp(foot + 24, MAGIC_HUFF_INDEX, 8) != 0) {
+        return -1;
     }
 
-    // 7. Leer bit por bit y recorrer el árbol
-    BitReader br;
-    br_init(&br, fd_in);
-
-    uint64_t written = 0;
-    while (written < total_bytes) {
-        Node *curr = root;
-
-        // bajar por el árbol hasta llegar a una hoja
-        while (curr->left != NULL || curr->right != NULL) {
-            int bit;
-            if (!br_read_bit(&br, &bit)) {
-                fprintf(stderr, "Error: datos comprimidos insuficientes\n");
-                close(fd_in);
-                close(fd_out);
-                free_tree(root);
-                return -1;
-            }
+    uint64_t nblocks = load_le64(foot);
+    uint64_t total = load_le64(foot + 8);
+    uint64_t index_off = load_le64(foot + 16);
+    if (nblocks > size / 8 || index_off + nblocks * 8 + sizeof(foot) != size) return -1;
+
+    uint8_t *raw_index = malloc(nblocks * 8 + 1);
+    BlockInfo *blocks = malloc(sizeof(BlockInfo) * (nblocks + 1));
+    if (!raw_index || !blocks
+        || pread_all(fd, raw_index, nblocks * 8, (off_t)index_off) != 0) {
+        free(raw_index);
+        free(blocks);
+        return -1;
+    }
 
-            if (bit == 0) {
-                curr = curr->left;
-            } else {
-                curr = curr->right;
-            }
+    uint64_t comp_off = sizeof(magic), raw_off = 0;
+    for (uint64_t i = 0; i < nblocks; i++) {
+        blocks[i].raw_len = load_le32(raw_index + 8 * i);
+        blocks[i].comp_len = load_le32(raw_index + 8 * i + 4);
+        blocks[i].comp_off = comp_off + 8;
+        blocks[i].raw_off = raw_off;
+        if (blocks[i].raw_len == 0 || blocks[i].raw_len > HUFF_MAX_BLOCK_SIZE) {
+            free(raw_index);
+            free(blocks);
+            return -1;
         }
+        comp_off += 8 + (uint64_t)blocks[i].comp_len;
+        raw_off += blocks[i].raw_len;
+    }
+    free(raw_index);
+    if (comp_off + 8 != index_off || raw_off != total) {
+        free(blocks);
+        return -1;
+    }
 
-        uint8_t original_byte = curr->byte;
+    *out_blocks = blocks;
+    *out_nblocks = (uint32_t)nblocks;
+    *out_total = total;
+    return 0;
+}
 
-        ssize_t w = write(fd_out, &original_byte, 1);
-        if (w != 1) {
+// Estado compartido por los hilos que descomprimen los bloques de un archivo
+typedef struct {
+    int fd_in;
+    int fd_out;
+    const BlockInfo *blocks;
+    uint32_t nblocks;
+    uint32_t next_block;   // siguiente bloque por descomprimir
+    uint32_t max_comp;     // tamaño del bloque comprimido más grande
+    uint32_t max_raw;      // tamaño del bloque original más grande
+    int error;
+    pthread_mutex_t lock;
+} BlockDecompressJob;
+
+// Cada hilo toma un bloque, lo lee con pread, lo decodifica en memoria y lo escribe con pwrite
+// en su posición del archivo final. No hace falta esperar a los demás bloques.
+static void* block_decompress_worker(void *arg) {
+    BlockDecompressJob *job = (BlockDecompressJob*)arg;
+    uint8_t *comp_buf = malloc(job->max_comp + 1);
+    uint8_t *raw_buf = malloc(job->max_raw + 1);
+    Decoder *dec = malloc(sizeof(Decoder));
+    int ok = comp_buf && raw_buf && dec;
+    if (!ok) perror("malloc");
+
+    while (ok) {
+        pthread_mutex_lock(&job->lock);
+        uint32_t idx = job->next_block++;
+        int stop = job->error || idx >= job->nblocks;
+        pthread_mutex_unlock(&job->lock);
+        if (stop) break;
+
+        const BlockInfo *b = &job->blocks[idx];
+        if (pread_all(job->fd_in, comp_buf, b->comp_len, (off_t)b->comp_off) != 0
+            || decode_block(dec, comp_buf, b->comp_len, raw_buf, b->raw_len) != 0) {
+            fprintf(stderr, "Error: bloque %u corrupto\n", idx);
+            ok = 0;
+        } else if (pwrite_all(job->fd_out, raw_buf, b->raw_len, (off_t)b->raw_off) != 0) {
             perror("write output");
+            ok = 0;
+        }
+    }
+
+    if (!ok) {
+        pthread_mutex_lock(&job->lock);
+        job->error = 1;
+        pthread_mutex_unlock(&job->lock);
+    }
+    free(comp_buf);
+    free(raw_buf);
+    free(dec);
+    return NULL;
+}
+
+// Formato por bloques con índice: los bloques se reparten entre num_threads hilos.
+// fd_out tiene que ser un archivo regular; se cierra al terminar.
+static int decompress_blocks_parallel(int fd_in, int fd_out, const BlockInfo *blocks,
+                                      uint32_t nblocks, uint64_t total, int num_threads) {
+    // Reservar el tamaño final: cada hilo escribe directo en su offset
+    if (ftruncate(fd_out, (off_t)total) != 0) {
+        perror("ftruncate output");
+        close(fd_out);
+        return -1;
+    }
+
+    BlockDecompressJob job;
+    memset(&job, 0, sizeof(job));
+    job.fd_in = fd_in;
+    job.fd_out = fd_out;
+    job.blocks = blocks;
+    job.nblocks = nblocks;
+    for (uint32_t i = 0; i < nblocks; i++) {
+        if (blocks[i].comp_len > job.max_comp) job.max_comp = blocks[i].comp_len;
+        if (blocks[i].raw_len > job.max_raw) job.max_raw = blocks[i].raw_len;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    int nt = num_threads;
+    if (nt > (int)nblocks) nt = (int)nblocks;
+    if (nt < 1) nt = 1;
+
+    run_threads(block_decompress_worker, &job, nt);
+
+    pthread_mutex_destroy(&job.lock);
+    if (close(fd_out) != 0) {
+        perror("close output");
+        job.error = 1;
+    }
+    return job.error ? -1 : 0;
+}
+
+// Devuelve 0 si todo bien, -1 si error
+int decompress_file_mt(const char *input_path, const char *output_path, int num_threads) {
+    // 1. Abrir archivo .huff para lectura
+    int fd_in = open_input(input_path);
+    if (fd_in < 0) {
+        perror("open input");
+        return -1;
+    }
+
+    // 2. Si es por bloques y tiene índice, cada hilo descomprime bloques completos por su cuenta
+    //    (hace falta poder escribir en cualquier posición de la salida, así que no con "-")
+    BlockInfo *blocks;
+    uint32_t nblocks;
+    uint64_t total;
+    if (strcmp(output_path, "-") != 0 && read_block_index(fd_in, &blocks, &nblocks, &total) == 0) {
+        int fd_out = open_output(output_path);
+        if (fd_out < 0) {
+            perror("open output");
+            free(blocks);
             close(fd_in);
-            close(fd_out);
-            free_tree(root);
             return -1;
         }
-
-        written++;
+        // Los bloques se escriben con pwrite en cualquier orden: solo si la salida es un archivo
+        // regular. Hacia un pipe, una fifo o una terminal se decodifica en orden sobre el mismo
+        // descriptor (volver a abrir una fifo le cortaría la salida al que lee).
+        struct stat st_out;
+        if (fstat(fd_out, &st_out) == 0 && S_ISREG(st_out.st_mode)) {
+            int status = decompress_blocks_parallel(fd_in, fd_out, blocks, nblocks, total, num_threads);
+            free(blocks);
+            close(fd_in);
+            return status;
+        }
+        free(blocks);
+        return decompress_into(fd_in, output_path, fd_out);
     }
 
-    close(fd_in);
-    close(fd_out);
-    free_tree(root);
+    // 3. Cualquier otro formato se lee de principio a fin
+    return decompress_fd(fd_in, output_path);
+}
 
-    return 0;
+// Devuelve 0 si todo bien, -1 si error al abrir archivo
+int decompress_file(const char *input_path, const char *output_path) {
+    return decompress_file_mt(input_path, output_path, 1);
 }
@@ -1,28 +1,116 @@
 #include <stdint.h>
 #include <stddef.h> 
 
-// Cada nodo del árbol de Huffman
+// Cada nodo del árbol de Huffman. Los hijos son índices dentro del arreglo de nodos del árbol
+// (-1 si no hay hijo), así todo el árbol vive en un solo bloque de memoria y no se pide nada al heap.
 typedef struct Node {
-    unsigned char byte;      // el valor del byte (si el nodo es hoja)
     uint64_t freq;           // cuántas veces aparece esa letra en el árbol
-    struct Node *left;       // hijo izquierdo (puntero)
-    struct Node *right;      // hijo derecho (puntero)
+    int16_t left;            // índice del hijo izquierdo (-1 si es hoja)
+    int16_t right;           // índice del hijo derecho (-1 si es hoja)
+    unsigned char byte;      // el valor del byte (si el nodo es hoja)
 } Node;
 
+// Con 256 hojas como máximo, un árbol binario completo tiene a lo sumo 2*256-1 nodos
+#define HUFF_MAX_NODES 511
+
+// Árbol de Huffman plano: los nodos se reservan en orden dentro de nodes[]
+typedef struct {
+    Node nodes[HUFF_MAX_NODES];
+    int count;               // cuántos nodos se usaron
+    int root;                // índice de la raíz (-1 si el árbol está vacío)
+} HuffTree;
+
 
 // Cola de prioridad mínima (min-heap) para construir el árbol.
 // Siempre sacamos los 2 nodos con menor frecuencia y los unimos en un nodo padre, cuya frecuencia es la suma de los dos
 typedef struct {
-    Node* data[256]; // soportamos hasta 256 símbolos distintos
-    int size;        // cuántos nodos hay actualmente en el heap
+    int16_t data[256]; // índices de nodos del árbol; soportamos hasta 256 símbolos distintos
+    int size;          // cuántos nodos hay actualmente en el heap
 } MinHeap;
 
 
+// Longitud máxima de un código Huffman, en bits. Se puede cambiar al compilar (-DHUFF_MAX_CODE_LEN=13),
+// entre 8 (lo mínimo para 256 símbolos) y 15. Los códigos cortos permiten decodificar con tablas pequeñas.
+#ifndef HUFF_MAX_CODE_LEN
+#define HUFF_MAX_CODE_LEN 11
+#endif
+#if HUFF_MAX_CODE_LEN < 8 || HUFF_MAX_CODE_LEN > 15
+#error "HUFF_MAX_CODE_LEN debe estar entre 8 y 15"
+#endif
+
+// Tamaño de cada bloque del formato por bloques. Un archivo más grande que esto se comprime
+// en bloques independientes (y un archivo de hasta este tamaño, en un solo bloque).
+#define HUFF_BLOCK_SIZE (1 << 20)
+
 typedef struct {
     uint32_t code;    // bits del código
     uint32_t length;  // cuántos bits del código son válidos
 } Code;
 
 
+// Cuenta cuántas veces aparece cada byte de data[0..len) y lo suma a freq.
+// Es el mismo conteo que usa el compresor; sirve para cualquier otro que necesite el histograma.
+void huffman_histogram(const uint8_t *data, size_t len, uint64_t freq[256]);
+
+// Cuántos bits ocuparían los datos de ese histograma con los códigos que usaría el compresor
+// (sin contar la tabla). Sirve para decidir sin comprimir si vale la pena hacerlo.
+uint64_t huffman_estimate_bits(const uint64_t freq[256]);
+
+// Comprime/descomprime un archivo. Devuelven 0 si todo bien, -1 si error.
+// La ruta "-" significa entrada o salida estándar; si la entrada no es un archivo regular
+// se comprime por bloques en una sola pasada, sin volver atrás.
 int compress_file(const char *input_path, const char *output_path);
-int decompress_file(const char *input_path, const char *output_path);
\ No newline at end of file
+int decompress_file(const char *input_path, const char *output_path);
+
+// Igual que compress_file, pero los archivos más grandes que un bloque se dividen en bloques
+// independientes que se comprimen en paralelo con num_threads hilos.
+int compress_file_mt(const char *input_path, const char *output_path, int num_threads);
+
+// Igual que compress_file_mt, pero entre descriptores ya abiertos (no cierra ninguno). fd_out se
+// escribe en orden, de principio a fin, así que puede ser un pipe.
+int compress_fd_mt(int fd_in, int fd_out, int num_threads);
+
+// Comprime un archivo completo a memoria, con el mismo formato que escribiría compress_file.
+// Si devuelve 0, *out apunta a *out_len bytes que se liberan con free().
+int compress_file_to_memory(const char *input_path, uint8_t **out, size_t *out_len);
+// Igual, pero un archivo de más de un bloque se comprime con num_threads hilos
+int compress_file_to_memory_mt(const char *input_path, uint8_t **out, size_t *out_len, int num_threads);
+
+// Piezas del formato por bloques, para quien reparte los bloques de un archivo entre sus propios hilos.
+// Un .huff por bloques es: los 8 bytes de huffman_blocks_head, cada bloque de huffman_encode_block
+// en orden y al final la cola de huffman_blocks_tail. Es el mismo resultado que compress_file.
+void huffman_blocks_head(uint8_t head[8]);
+// Comprime src[0..len) (1 <= len <= HUFF_BLOCK_SIZE) como un bloque. *out se libera con free().
+int huffman_encode_block(const uint8_t *src, size_t len, uint8_t **out, size_t *out_len);
+// Índice y pie para los bloques ya comprimidos blocks[0..nblocks). *out se libera con free().
+int huffman_blocks_tail(uint8_t *const *blocks, uint32_t nblocks, uint8_t **out, size_t *out_len);
+
+// Descomprime un .huff que ya está completo en memoria (src[0..len)) hacia output_path.
+// No modifica src, así que varios hilos pueden leer del mismo buffer (por ejemplo un mmap).
+int decompress_memory(const uint8_t *src, size_t len, const char *output_path);
+
+// Descomprime leyendo fd_in de principio a fin, sin volver atrás (puede ser un pipe).
+// Cierra fd_in al terminar. Devuelve 0 si todo bien, -1 si error.
+int decompress_fd(int fd_in, const char *output_path);
+
+// Tabla de códigos compartida por varios archivos (modo sólido del .har): la tabla se guarda
+// una sola vez y cada archivo lleva solo su tamaño original (varint) y sus bits.
+typedef struct HuffShared HuffShared;
+// Arma la tabla con un histograma conjunto. Todos los bytes reciben código, aunque no aparezcan
+// en freq, así se puede codificar cualquier archivo. NULL si no hay memoria.
+HuffShared* huffman_shared_build(const uint64_t freq[256]);
+// La tabla serializada (*out se libera con free()) y el camino inverso (NULL si no es válida)
+int huffman_shared_save(const HuffShared *sh, uint8_t **out, size_t *out_len);
+HuffShared* huffman_shared_load(const uint8_t *src, size_t len);
+void huffman_shared_free(HuffShared *sh);
+// Como huffman_estimate_bits, pero con los códigos de la tabla compartida
+uint64_t huffman_shared_estimate_bits(const HuffShared *sh, const uint64_t freq[256]);
+// Comprime src[0..len) con la tabla. *out se libera con free().
+int huffman_shared_encode(const HuffShared *sh, const uint8_t *src, size_t len, uint8_t **out, size_t *out_len);
+// Descomprime un resultado de huffman_shared_encode hacia output_path. La tabla no se modifica,
+// así que varios hilos la pueden usar a la vez.
+int huffman_shared_decode(const HuffShared *sh, const uint8_t *src, size_t len, const char *output_path);
+
+// Igual que decompress_file, pero un .huff por bloques se descomprime con num_threads hilos:
+// cada hilo decodifica bloques completos y los escribe directo en su posición del archivo final.
+int decompress_file_mt(const char *input_path, const char *output_path, int num_threads);
\ No newline at end of file
@@ -0,0 +1,522 @@
+#define _GNU_SOURCE  // F_SETPIPE_SZ
+#include "pipeline.h"
+#include "../Huffman/huffman.h"
+#include "../Cesar/cesar.h"
+#include "../FileList/filelist.h"
+#include <pthread.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+
+static const char MAGIC_HSEC[8] = "GSHSEC10";
+
+// Formato .hsec:
+//   "GSHSEC10", tipo u8 (HSEC_FILE o HSEC_DIR) y los mismos 8 bytes del magic encriptados con
+//   la clave, para avisar de una clave incorrecta antes de descomprimir basura. Todo lo que
+//   viene después está encriptado con César:
+//     HSEC_FILE: el .huff del archivo, hasta el final
+//     HSEC_DIR:  cantidad u32, y por entrada: largo ruta u16, ruta, tamaño comprimido u64 y el
+//                .huff del archivo. Las entradas quedan en el orden en que terminan los hilos.
+#define HSEC_HEAD 17
+#define HSEC_FILE 0
+#define HSEC_DIR  1
+
+// Tamaño de los pedazos que pasan por el pipe entre Huffman y César
+#define HSEC_BUF_SIZE (1 << 20)
+
+// Igual que pread_all, y después desencripta lo leído
+static int pread_decrypt(int fd, void *buf, size_t len, off_t off, unsigned char key) {
+    if (pread_all(fd, buf, len, off) != 0) return -1;
+    cesar_decrypt_buffer(buf, buf, len, key);
+    return 0;
+}
+
+static void hsec_head(unsigned char head[HSEC_HEAD], int kind, unsigned char key) {
+    memcpy(head, MAGIC_HSEC, 8);
+    head[8] = (unsigned char)kind;
+    cesar_encrypt_buffer((const unsigned char *)MAGIC_HSEC, head + 9, 8, key);
+}
+
+// Devuelve el tipo del .hsec, o -1 si no es un .hsec o la clave no es la correcta
+static int hsec_check(const unsigned char head[HSEC_HEAD], unsigned char key) {
+    if (memcmp(head, MAGIC_HSEC, 8) != 0 || (head[8] != HSEC_FILE && head[8] != HSEC_DIR)) {
+        fprintf(stderr, "Error: no es un archivo .hsec\n");
+        return -1;
+    }
+    unsigned char check[8];
+    cesar_decrypt_buffer(head + 9, check, 8, key);
+    if (memcmp(check, MAGIC_HSEC, 8) != 0) {
+        fprintf(stderr, "Error: clave incorrecta\n");
+        return -1;
+    }
+    return head[8];
+}
+
+// Pasa todo fd_in a fd_out aplicando César por pedazos (encriptando, o desencriptando si decrypt)
+static int cesar_stream(int fd_in, int fd_out, unsigned char key, int decrypt) {
+    unsigned char *buf = malloc(HSEC_BUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    int status = 0;
+    while (1) {
+        ssize_t r = read(fd_in, buf, HSEC_BUF_SIZE);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            status = -1;
+            break;
+        }
+        if (r == 0) break;
+        if (decrypt) cesar_decrypt_buffer(buf, buf, (size_t)r, key);
+        else cesar_encrypt_buffer(buf, buf, (size_t)r, key);
+        if (write_all(fd_out, buf, (size_t)r) != 0) {
+            // EPIPE: el otro lado ya terminó (y avisa él mismo por qué)
+            if (errno != EPIPE) perror("write");
+            status = -1;
+            break;
+        }
+    }
+    free(buf);
+    return status;
+}
+
+// # Un archivo: dos etapas unidas por un pipe
+// Una etapa corre en un hilo y la otra en el que llama, así comprimir y encriptar (o desencriptar
+// y descomprimir) se solapan y los datos intermedios solo existen en el buffer del pipe.
+// Cada etapa cierra su extremo del pipe al terminar: si una falla, la otra ve el final (o EPIPE)
+// y también termina, sin quedarse esperando.
+typedef struct {
+    int fd_in;
+    int fd_out;            // extremo de escritura del pipe (la etapa lo cierra)
+    unsigned char key;
+    int num_threads;
+    int status;
+    uint64_t off, len;     // decrypt_range_stage: la parte de fd_in que pasa por el pipe
+} Stage;
+
+static void* compress_stage(void *arg) {
+    Stage *s = arg;
+    s->status = compress_fd_mt(s->fd_in, s->fd_out, s->num_threads);
+    close(s->fd_out);
+    return NULL;
+}
+
+static void* decrypt_stage(void *arg) {
+    Stage *s = arg;
+    s->status = cesar_stream(s->fd_in, s->fd_out, s->key, 1);
+    close(s->fd_out);
+    return NULL;
+}
+
+// Como decrypt_stage pero solo con len bytes de fd_in desde off, leídos con pread: varios hilos
+// pueden leer así distintas entradas del mismo .hsec
+static void* decrypt_range_stage(void *arg) {
+    Stage *s = arg;
+    unsigned char *buf = malloc(HSEC_BUF_SIZE);
+    s->status = 0;
+    if (!buf) {
+        perror("malloc");
+        s->status = -1;
+    }
+    uint64_t off = s->off, left = s->len;
+    while (s->status == 0 && left > 0) {
+        size_t n = left < HSEC_BUF_SIZE ? (size_t)left : HSEC_BUF_SIZE;
+        if (pread_decrypt(s->fd_in, buf, n, (off_t)off, s->key) != 0) {
+            perror("read");
+            s->status = -1;
+        } else if (write_all(s->fd_out, buf, n) != 0) {
+            if (errno != EPIPE) perror("write");
+            s->status = -1;
+        }
+        off += n;
+        left -= n;
+    }
+    free(buf);
+    close(s->fd_out);
+    return NULL;
+}
+
+// Crea el pipe y arranca 'stage' en un hilo escribiendo en él. Devuelve el extremo de lectura,
+// o -1 si error (y entonces cierra lo que abrió, pero no s->fd_in).
+static int start_stage(pthread_t *thread, void *(*stage)(void *), Stage *s) {
+    int p[2];
+    if (pipe(p) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    // Un pipe más grande que el de 64 KiB por defecto: menos cambios entre los dos hilos
+    fcntl(p[1], F_SETPIPE_SZ, HSEC_BUF_SIZE);
+    s->fd_out = p[1];
+    if (pthread_create(thread, NULL, stage, s) != 0) {
+        perror("pthread_create");
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+    return p[0];
+}
+
+static int encode_file(const char *input_path, const char *output_path, unsigned char key, int num_threads) {
+    int fd_in = open_input(input_path);
+    if (fd_in < 0) {
+        perror("open input");
+        return -1;
+    }
+    int fd_out = open_output(output_path);
+    if (fd_out < 0) {
+        perror("open output");
+        close(fd_in);
+        return -1;
+    }
+
+    unsigned char head[HSEC_HEAD];
+    hsec_head(head, HSEC_FILE, key);
+    int status = -1;
+    if (write_all(fd_out, head, sizeof(head)) != 0) {
+        perror("write");
+    } else {
+        Stage s = { fd_in, -1, key, num_threads, -1, 0, 0 };
+        pthread_t thread;
+        int fd_pipe = start_stage(&thread, compress_stage, &s);
+        if (fd_pipe >= 0) {
+            status = cesar_stream(fd_pipe, fd_out, key, 0);
+            close(fd_pipe);
+            pthread_join(thread, NULL);
+            if (s.status != 0) status = -1;
+        }
+    }
+
+    close(fd_in);
+    if (close(fd_out) != 0) status = -1;
+    if (status != 0 && strcmp(output_path, "-") != 0) unlink(output_path);
+    return status;
+}
+
+// fd_in ya está después del encabezado; lo cierra al terminar
+static int decode_file(int fd_in, const char *output_path, unsigned char key) {
+    Stage s = { fd_in, -1, key, 1, -1, 0, 0 };
+    pthread_t thread;
+    int fd_pipe = start_stage(&thread, decrypt_stage, &s);
+    if (fd_pipe < 0) {
+        close(fd_in);
+        return -1;
+    }
+    int status = decompress_fd(fd_pipe, output_path);  // cierra fd_pipe
+    pthread_join(thread, NULL);
+    close(fd_in);
+    return status == 0 && s.status == 0 ? 0 : -1;
+}
+
+// # Carpeta
+// Un archivo de hasta un bloque lo comprime un hilo en memoria, lo encripta ahí mismo y lo escribe
+// con pwrite en un lugar reservado con el candado, igual que el .har. Uno más grande pasa por las
+// mismas dos etapas que un archivo solo y se escribe encriptado por pedazos al final del .hsec,
+// así la memoria no depende del tamaño de los archivos. Al desencriptar, un recorrido de los
+// encabezados anota dónde está cada entrada; una chica se lee entera a memoria y una grande se
+// lee por ventanas con pread y pasa por un pipe hacia el descompresor.
+typedef struct {
+    const char *base;        // carpeta de entrada (encriptar) o de salida (desencriptar)
+    FileList files;          // al desencriptar, size es el tamaño comprimido de la entrada
+    uint64_t *offsets;       // al desencriptar, dónde empieza el .huff de cada entrada
+    int fd;                  // el .hsec
+    uint64_t end;            // al encriptar, dónde va la próxima entrada (con el candado)
+    size_t next_file;        // siguiente archivo por hacer (con el candado)
+    unsigned char key;
+    int error;
+    pthread_mutex_t lock;
+} DirJob;
+
+static void dir_fail(DirJob *job) {
+    pthread_mutex_lock(&job->lock);
+    job->error = 1;
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Encabezado encriptado de la entrada idx (ruta y tamaño comprimido). Se libera con free().
+static unsigned char* entry_header(DirJob *job, size_t idx, uint64_t comp, size_t *hlen) {
+    const char *path = filelist_path(&job->files, idx);
+    unsigned short plen = strlen(path);
+    *hlen = 2 + plen + 8;
+    unsigned char *hdr = malloc(*hlen);
+    if (!hdr) {
+        perror("malloc");
+        return NULL;
+    }
+    memcpy(hdr, &plen, 2);
+    memcpy(hdr + 2, path, plen);
+    memcpy(hdr + 2 + plen, &comp, 8);
+    cesar_encrypt_buffer(hdr, hdr, *hlen, job->key);
+    return hdr;
+}
+
+// Comprime el archivo idx (de hasta un bloque) en memoria, lo encripta y lo agrega al final del .hsec
+static int store_entry(DirJob *job, size_t idx) {
+    char *full = path_join(job->base, filelist_path(&job->files, idx));
+    if (!full) {
+        perror("malloc");
+        return -1;
+    }
+    uint8_t *data;
+    size_t len;
+    int r = compress_file_to_memory_mt(full, &data, &len, 1);
+    free(full);
+    if (r != 0) return -1;
+
+    size_t hlen;
+    unsigned char *hdr = entry_header(job, idx, len, &hlen);
+    if (!hdr) {
+        free(data);
+        return -1;
+    }
+    cesar_encrypt_buffer(data, data, len, job->key);
+
+    pthread_mutex_lock(&job->lock);
+    uint64_t off = job->end;
+    job->end += hlen + len;
+    pthread_mutex_unlock(&job->lock);
+
+    r = pwrite_all(job->fd, hdr, hlen, (off_t)off) == 0 && pwrite_all(job->fd, data, len, (off_t)(off + hlen)) == 0 ? 0 : -1;
+    if (r != 0) perror("write");
+    free(hdr);
+    free(data);
+    return r;
+}
+
+// Archivo de más de un bloque: lo hace el hilo principal antes de repartir los chicos, así que
+// es el único que escribe y puede agregar al final del .hsec a medida que salen los bloques
+// comprimidos (con num_threads hilos), encriptándolos por pedazos. El tamaño comprimido se
+// conoce al final: el encabezado se escribe después, en el lugar que se dejó.
+static int stream_entry(DirJob *job, size_t idx, int num_threads) {
+    char *full = path_join(job->base, filelist_path(&job->files, idx));
+    if (!full) {
+        perror("malloc");
+        return -1;
+    }
+    int fd_in = open(full, O_RDONLY);
+    free(full);
+    if (fd_in < 0) {
+        perror("open input");
+        return -1;
+    }
+
+    uint64_t data_off = job->end + 2 + strlen(filelist_path(&job->files, idx)) + 8;
+    int status = -1;
+    if (lseek(job->fd, (off_t)data_off, SEEK_SET) < 0) {
+        perror("lseek");
+    } else {
+        Stage s = { fd_in, -1, job->key, num_threads, -1, 0, 0 };
+        pthread_t thread;
+        int fd_pipe = start_stage(&thread, compress_stage, &s);
+        if (fd_pipe >= 0) {
+            status = cesar_stream(fd_pipe, job->fd, job->key, 0);
+            close(fd_pipe);
+            pthread_join(thread, NULL);
+            if (s.status != 0) status = -1;
+        }
+    }
+    close(fd_in);
+    off_t end = status == 0 ? lseek(job->fd, 0, SEEK_CUR) : -1;
+    if (end < 0) return -1;
+
+    size_t hlen;
+    unsigned char *hdr = entry_header(job, idx, (uint64_t)end - data_off, &hlen);
+    if (!hdr) return -1;
+    if (pwrite_all(job->fd, hdr, hlen, (off_t)job->end) != 0) {
+        perror("write");
+        status = -1;
+    }
+    free(hdr);
+    job->end = (uint64_t)end;
+    return status;
+}
+
+// Los archivos de más de un bloque ya los hizo el hilo principal con todos los hilos
+static void* encode_worker(void *arg) {
+    DirJob *job = arg;
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        while (job->next_file < job->files.count && job->files.items[job->next_file].size > HUFF_BLOCK_SIZE) job->next_file++;
+        int stop = job->error || job->next_file >= job->files.count;
+        size_t idx = job->next_file++;
+        pthread_mutex_unlock(&job->lock);
+        if (stop) break;
+        if (store_entry(job, idx) != 0) dir_fail(job);
+    }
+    return NULL;
+}
+
+// Entrada chica: se lee entera, se desencripta y se descomprime desde memoria
+static int load_entry(DirJob *job, size_t idx, const char *full) {
+    uint64_t comp = job->files.items[idx].size;
+    uint8_t *buf = malloc(comp ? comp : 1);
+    int r = -1;
+    if (!buf) {
+        perror("malloc");
+    } else if (pread_decrypt(job->fd, buf, comp, (off_t)job->offsets[idx], job->key) != 0) {
+        perror("read");
+    } else {
+        r = decompress_memory(buf, comp, full);
+    }
+    free(buf);
+    return r;
+}
+
+// Entrada grande: un hilo la lee por ventanas de HSEC_BUF_SIZE, las desencripta y las pasa por
+// un pipe al descompresor, así no se tiene nunca la entrada entera en memoria
+static int pipe_entry(DirJob *job, size_t idx, const char *full) {
+    Stage s = { job->fd, -1, job->key, 1, -1, job->offsets[idx], job->files.items[idx].size };
+    pthread_t thread;
+    int fd_pipe = start_stage(&thread, decrypt_range_stage, &s);
+    if (fd_pipe < 0) return -1;
+    int status = decompress_fd(fd_pipe, full);  // cierra fd_pipe
+    pthread_join(thread, NULL);
+    return status == 0 && s.status == 0 ? 0 : -1;
+}
+
+static void* decode_worker(void *arg) {
+    DirJob *job = arg;
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        int stop = job->error || job->next_file >= job->files.count;
+        size_t idx = job->next_file++;
+        pthread_mutex_unlock(&job->lock);
+        if (stop) break;
+
+        char *full = path_join(job->base, filelist_path(&job->files, idx));
+        int r = -1;
+        if (!full) {
+            perror("malloc");
+        } else {
+            mkdirs_for_file(full);
+            r = job->files.items[idx].size > HSEC_BUF_SIZE ? pipe_entry(job, idx, full) : load_entry(job, idx, full);
+        }
+        if (r != 0) dir_fail(job);
+        free(full);
+    }
+    return NULL;
+}
+
+static int encode_dir(const char *input_path, const char *output_path, unsigned char key, int num_threads) {
+    DirJob job = { input_path, {0}, NULL, -1, HSEC_HEAD + 4, 0, key, 0, PTHREAD_MUTEX_INITIALIZER };
+    filelist_init(&job.files);
+    if (filelist_scan(&job.files, input_path) != 0) { filelist_free(&job.files); return -1; }
+    if (job.files.count == 0) { printf("Carpeta vacía\n"); filelist_free(&job.files); return -1; }
+    job.fd = open(output_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (job.fd < 0) { perror("open output"); filelist_free(&job.files); return -1; }
+    printf("Comprimiendo y encriptando %zu archivos (clave=%u) usando %d hilos...\n",
+           job.files.count, (unsigned)key, num_threads);
+
+    // Un archivo de más de un bloque se hace de a uno con todos los hilos (se reparten sus
+    // bloques); los demás se reparten entre los hilos, un archivo entero por hilo
+    for (size_t i = 0; i < job.files.count && !job.error; i++)
+        if (job.files.items[i].size > HUFF_BLOCK_SIZE && stream_entry(&job, i, num_threads) != 0) job.error = 1;
+    if (!job.error) run_threads(encode_worker, &job, num_threads);
+
+    // El encabezado va al final, cuando ya se sabe que todo salió bien
+    unsigned char head[HSEC_HEAD + 4];
+    unsigned int count = job.files.count;
+    hsec_head(head, HSEC_DIR, key);
+    cesar_encrypt_buffer((const unsigned char *)&count, head + HSEC_HEAD, 4, key);
+    if (!job.error && pwrite_all(job.fd, head, sizeof(head), 0) != 0) {
+        perror("write");
+        job.error = 1;
+    }
+    if (close(job.fd) != 0) job.error = 1;
+    if (job.error) unlink(output_path);
+    pthread_mutex_destroy(&job.lock);
+    filelist_free(&job.files);
+    if (job.error) return -1;
+    printf("OK: %s\n", output_path);
+    return 0;
+}
+
+// Recorre los encabezados de las entradas (sin leer los .huff) y anota cada una en job
+static int read_entries(DirJob *job, unsigned int count, uint64_t file_size) {
+    job->offsets = malloc((count ? count : 1) * sizeof(uint64_t));
+    char *path = malloc(FILELIST_MAX_PATH + 1);
+    if (!job->offsets || !path) { perror("malloc"); free(path); return -1; }
+    uint64_t pos = HSEC_HEAD + 4;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned short plen;
+        uint64_t comp;
+        if (pread_decrypt(job->fd, &plen, 2, (off_t)pos, job->key) != 0 ||
+            pread_decrypt(job->fd, path, plen, (off_t)(pos + 2), job->key) != 0 ||
+            pread_decrypt(job->fd, &comp, 8, (off_t)(pos + 2 + plen), job->key) != 0 ||
+            comp > file_size - (pos + 2 + plen + 8)) {
+            fprintf(stderr, "Error: .hsec dañado o incompleto (entrada %u)\n", i);
+            free(path);
+            return -1;
+        }
+        if (filelist_add(&job->files, path, plen, comp, 0) != 0) { perror("malloc"); free(path); return -1; }
+        job->offsets[i] = pos + 2 + plen + 8;
+        pos = job->offsets[i] + comp;
+    }
+    free(path);
+    return 0;
+}
+
+// fd ya pasó hsec_check; lo cierra al terminar
+static int decode_dir(int fd, const char *output_path, unsigned char key, int num_threads) {
+    DirJob job = { output_path, {0}, NULL, fd, 0, 0, key, 0, PTHREAD_MUTEX_INITIALIZER };
+    filelist_init(&job.files);
+    struct stat st;
+    unsigned int count;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || pread_decrypt(fd, &count, 4, HSEC_HEAD, key) != 0) {
+        fprintf(stderr, "Error: una carpeta .hsec se lee de un archivo completo (no de un pipe)\n");
+        job.error = 1;
+    } else if (read_entries(&job, count, (uint64_t)st.st_size) != 0) {
+        job.error = 1;
+    } else {
+        mkdir(output_path, 0755);
+        printf("Desencriptando y descomprimiendo %u archivos (clave=%u) usando %d hilos...\n",
+               count, (unsigned)key, num_threads);
+        run_threads(decode_worker, &job, num_threads);
+    }
+    close(fd);
+    pthread_mutex_destroy(&job.lock);
+    free(job.offsets);
+    filelist_free(&job.files);
+    if (job.error) return -1;
+    printf("OK: %s\n", output_path);
+    return 0;
+}
+
+int compress_encrypt(const char *input_path, const char *output_path, unsigned char key, int num_threads) {
+    struct stat st;
+    if (strcmp(input_path, "-") != 0 && stat(input_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        if (strcmp(output_path, "-") == 0) {
+            fprintf(stderr, "Error: una carpeta necesita un archivo de salida (no \"-\")\n");
+            return -1;
+        }
+        return encode_dir(input_path, output_path, key, num_threads);
+    }
+    return encode_file(input_path, output_path, key, num_threads);
+}
+
+int decrypt_decompress(const char *input_path, const char *output_path, unsigned char key, int num_threads) {
+    int fd = open_input(input_path);
+    if (fd < 0) {
+        perror("open input");
+        return -1;
+    }
+    unsigned char head[HSEC_HEAD];
+    int kind = -1;
+    if (read_full(fd, head, sizeof(head)) != (ssize_t)sizeof(head)) {
+        fprintf(stderr, "Error: no es un archivo .hsec\n");
+    } else {
+        kind = hsec_check(head, key);
+    }
+    if (kind < 0) {
+        close(fd);
+        return -1;
+    }
+    if (kind == HSEC_DIR) return decode_dir(fd, output_path, key, num_threads);
+    return decode_file(fd, output_path, key);
+}
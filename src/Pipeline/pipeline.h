@@ -0,0 +1,16 @@
+// pipeline.h - Comprimir y encriptar (y al revés) en una sola pasada, sin archivos intermedios
+// Las etapas se pasan los datos por pipes: quien llama tiene que ignorar SIGPIPE (como hace
+// main.c) para que, si una etapa falla, la otra reciba EPIPE en lugar de terminar el proceso.
+
+// Comprime con Huffman y encripta con César un archivo o una carpeta:
+// - input_path: archivo ("-" = entrada estándar) o carpeta
+// - output_path: contenedor .hsec de salida ("-" = salida estándar, solo para un archivo)
+// - key: clave de César
+// - num_threads: hilos para comprimir (bloques de un archivo grande, o archivos de la carpeta)
+// El contenedor dice si adentro hay un archivo o una carpeta, así que para volver atrás
+// alcanza con decrypt_decompress. Devuelve 0 si OK, -1 si error
+int compress_encrypt(const char *input_path, const char *output_path, unsigned char key, int num_threads);
+
+// Desencripta y descomprime un .hsec hacia output_path (archivo, "-", o carpeta si el .hsec
+// tiene una carpeta). Devuelve 0 si OK, -1 si error (también si la clave no es la correcta)
+int decrypt_decompress(const char *input_path, const char *output_path, unsigned char key, int num_threads);
@@ -2,17 +2,27 @@
 #include <string.h>    // strcmp
 #include <stdlib.h>    // exit, EXIT_FAILURE, EXIT_SUCCESS
 #include <sys/stat.h>  // stat, S_ISDIR
+#include <signal.h>    // signal, SIGPIPE
 
 #include "cesar.h"
 #include "huffman.h"
 #include "archiver.h"  // para comprimir/descomprimir carpetas
+#include "pipeline.h"  // comprimir + encriptar en una pasada
 
 // Uso:
 //   ./gsea -c <archivo_o_carpeta> <salida>       Comprimir archivo o carpeta
-//   ./gsea -d <archivo.huff_o_.har> <salida>     Descomprimir
-//   ./gsea -c <carpeta> <salida.har> -t N        Comprimir carpeta con N hilos
+//   ./gsea -d <archivo.huff_o_.har> <salida>     Descomprimir (-t N: hilos para .huff grandes o .har)
+//   ./gsea -c <entrada> <salida> -t N            Comprimir archivo grande o carpeta con N hilos
+//   ./gsea -c <carpeta> <salida.har> --update    Actualizar un .har: recomprime solo lo que cambió
+//   ./gsea -c <carpeta> <salida.har> --solid     Una tabla compartida para todos los archivos chicos
+//   ./gsea -c - <salida> / -d <entrada> -         "-" = stdin/stdout (para pipes)
+//   ./gsea -l <archivo.har>                      Listar el contenido de un .har
+//   ./gsea -x <archivo.har> <ruta> <salida>      Extraer un solo archivo de un .har
 //   ./gsea -e <input> <output.sec> -k N          Encriptar César
 //   ./gsea -u <input.sec> <output> -k N          Desencriptar César
+//   ./gsea -e/-u ... -k N -t H                   Con H hilos (archivos grandes por rangos, o carpetas)
+//   ./gsea -ce <entrada> <salida.hsec> -k N [-t H]  Comprimir y encriptar en una pasada (archivo o carpeta)
+//   ./gsea -ud <entrada.hsec> <salida> -k N [-t H]  Desencriptar y descomprimir en una pasada
 
 // Helper: verifica si un path es directorio
 static int es_directorio(const char *path) {
@@ -24,15 +34,24 @@ static int es_directorio(const char *path) {
 static void print_usage(const char *prog) {
     fprintf(stderr,
         "Uso:\n"
-        "  %s -c <input> <output> [-t N]      Comprimir archivo o carpeta\n"
-        "  %s -d <input> <output>             Descomprimir\n"
+        "  %s -c <input> <output> [-t N] [--update] [--solid]  Comprimir archivo o carpeta\n"
+        "  %s -d <input> <output> [-t N]      Descomprimir\n"
+        "  %s -l <archivo.har>                Listar contenido del .har\n"
+        "  %s -x <archivo.har> <ruta> <output> Extraer un archivo del .har\n"
         "  %s -e <input> <output> -k K [-t N] Encriptar César (carpeta o archivo)\n"
-        "  %s -u <input> <output> -k K        Desencriptar César\n",
-        prog, prog, prog, prog
+        "  %s -u <input> <output> -k K [-t N] Desencriptar César\n"
+        "  %s -ce <input> <output> -k K [-t N] Comprimir y encriptar en una pasada\n"
+        "  %s -ud <input> <output> -k K [-t N] Desencriptar y descomprimir en una pasada\n",
+        prog, prog, prog, prog, prog, prog, prog, prog
     );
 }
 
 int main(int argc, char *argv[]) {
+    // Listar un .har: único comando con un solo argumento
+    if (argc == 3 && strcmp(argv[1], "-l") == 0) {
+        return list_archive(argv[2]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if (argc < 4) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
@@ -42,39 +61,56 @@ int main(int argc, char *argv[]) {
     const char *in_path = argv[2];
     const char *out_path = argv[3];
 
+    // Con "-" como salida los datos van por stdout, así que los mensajes van por stderr
+    FILE *mensajes = strcmp(out_path, "-") == 0 ? stderr : stdout;
+
     if (strcmp(flag, "-c") == 0) {
         // Comprimir: archivo o carpeta
-        // Detectar si hay opción -t para hilos
+        // Opciones: -t N (hilos), --update y --solid (solo carpetas)
         int num_hilos = 4;  // valor por defecto
-        if (argc >= 6 && strcmp(argv[4], "-t") == 0) {
-            num_hilos = atoi(argv[5]);
-            if (num_hilos < 1) num_hilos = 1;
+        int har_flags = 0;
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+                num_hilos = atoi(argv[++i]);
+                if (num_hilos < 1) num_hilos = 1;
+            } else if (strcmp(argv[i], "--update") == 0) {
+                har_flags |= HAR_UPDATE;
+            } else if (strcmp(argv[i], "--solid") == 0) {
+                har_flags |= HAR_SOLID;
+            } else {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
         }
 
         // Si es directorio, usar archivador con hilos
         if (es_directorio(in_path)) {
-            if (compress_directory(in_path, out_path, num_hilos) != 0) {
+            if (compress_directory_flags(in_path, out_path, num_hilos, har_flags) != 0) {
                 fprintf(stderr, "Error al comprimir carpeta %s\n", in_path);
                 return EXIT_FAILURE;
             }
             printf("OK: carpeta %s -> %s (comprimida con %d hilos)\n", in_path, out_path, num_hilos);
         } else {
-            // Es archivo regular, usar Huffman normal
-            if (compress_file(in_path, out_path) != 0) {
+            // Es archivo regular, usar Huffman (por bloques en paralelo si es grande)
+            if (compress_file_mt(in_path, out_path, num_hilos) != 0) {
                 fprintf(stderr, "Error al comprimir %s\n", in_path);
                 return EXIT_FAILURE;
             }
-            printf("OK: %s -> %s (comprimido)\n", in_path, out_path);
+            fprintf(mensajes, "OK: %s -> %s (comprimido)\n", in_path, out_path);
         }
     }
     else if (strcmp(flag, "-d") == 0) {
-        if (argc != 4) {
+        int num_hilos = 4;  // valor por defecto
+        if (argc == 6 && strcmp(argv[4], "-t") == 0) {
+            num_hilos = atoi(argv[5]);
+            if (num_hilos < 1) num_hilos = 1;
+        } else if (argc != 4) {
             print_usage(argv[0]);
             return EXIT_FAILURE;
         }
 
-        // Descomprimir: detectar si es .har o .huff
-        int es_har = is_har_archive(in_path);
+        // Descomprimir: detectar si es .har o .huff ("-" = stdin, siempre .huff)
+        int es_har = strcmp(in_path, "-") != 0 ? is_har_archive(in_path) : 0;
         if (es_har < 0) {
             fprintf(stderr, "Error al verificar archivo %s\n", in_path);
             return EXIT_FAILURE;
@@ -82,20 +118,33 @@ int main(int argc, char *argv[]) {
 
         if (es_har) {
             // Es un archivo .har (carpeta comprimida)
-            if (decompress_directory(in_path, out_path) != 0) {
+            if (decompress_directory(in_path, out_path, num_hilos) != 0) {
                 fprintf(stderr, "Error al descomprimir carpeta %s\n", in_path);
                 return EXIT_FAILURE;
             }
             printf("OK: %s -> %s (carpeta descomprimida)\n", in_path, out_path);
         } else {
-            // Es archivo .huff normal
-            if (decompress_file(in_path, out_path) != 0) {
+            // Es archivo .huff normal (por bloques en paralelo si tiene índice)
+            if (decompress_file_mt(in_path, out_path, num_hilos) != 0) {
                 fprintf(stderr, "Error al descomprimir %s\n", in_path);
                 return EXIT_FAILURE;
             }
-            printf("OK: %s -> %s (descomprimido)\n", in_path, out_path);
+            fprintf(mensajes, "OK: %s -> %s (descomprimido)\n", in_path, out_path);
         }
     }
+    else if (strcmp(flag, "-x") == 0) {
+        // Extraer un solo archivo: -x <archivo.har> <ruta dentro del .har> <salida>
+        if (argc != 5) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (extract_file(in_path, argv[3], argv[4]) != 0) {
+            fprintf(stderr, "Error al extraer %s de %s\n", argv[3], in_path);
+            return EXIT_FAILURE;
+        }
+        FILE *msg = strcmp(argv[4], "-") == 0 ? stderr : stdout;
+        fprintf(msg, "OK: %s:%s -> %s (extraído)\n", in_path, argv[3], argv[4]);
+    }
     else if (strcmp(flag, "-e") == 0){
         if (argc < 6 || strcmp(argv[4], "-k") != 0) {
             print_usage(argv[0]);
@@ -119,7 +168,7 @@ int main(int argc, char *argv[]) {
             printf("OK: %s -> %s (carpeta encriptada con César, key=%u, %d hilos)\n", 
                    in_path, out_path, (unsigned)key, num_hilos);
         } else {
-            if (cesar_encrypt_file(in_path, out_path, key) != 0) {
+            if (cesar_encrypt_file_mt(in_path, out_path, key, num_hilos) != 0) {
                 fprintf(stderr, "Error al encriptar %s\n", in_path);
                 return EXIT_FAILURE;
             }
@@ -136,6 +185,12 @@ int main(int argc, char *argv[]) {
         unsigned long key_ul = strtoul(argv[5], NULL, 10);
         unsigned char key = (unsigned char)(key_ul & 0xFF);
 
+        int num_hilos = 4;
+        if (argc >= 8 && strcmp(argv[6], "-t") == 0) {
+            num_hilos = atoi(argv[7]);
+            if (num_hilos < 1) num_hilos = 1;
+        }
+
         int es_csar = is_csar_archive(in_path);
         if (es_csar < 0) {
             fprintf(stderr, "Error al verificar archivo %s\n", in_path);
@@ -143,14 +198,14 @@ int main(int argc, char *argv[]) {
         }
 
         if (es_csar) {
-            if (cesar_decrypt_directory(in_path, out_path, key) != 0) {
+            if (cesar_decrypt_directory(in_path, out_path, key, num_hilos) != 0) {
                 fprintf(stderr, "Error al desencriptar carpeta %s\n", in_path);
                 return EXIT_FAILURE;
             }
-            printf("OK: %s -> %s (carpeta desencriptada con César, key=%u)\n", 
-                   in_path, out_path, (unsigned)key);
+            printf("OK: %s -> %s (carpeta desencriptada con César, key=%u, %d hilos)\n", 
+                   in_path, out_path, (unsigned)key, num_hilos);
         } else {
-            if (cesar_decrypt_file(in_path, out_path, key) != 0) {
+            if (cesar_decrypt_file_mt(in_path, out_path, key, num_hilos) != 0) {
                 fprintf(stderr, "Error al desencriptar %s\n", in_path);
                 return EXIT_FAILURE;
             }
@@ -158,6 +213,41 @@ int main(int argc, char *argv[]) {
         }
         return EXIT_SUCCESS;
     }
+    else if (strcmp(flag, "-ce") == 0 || strcmp(flag, "-ud") == 0){
+        // Huffman + César sin archivo intermedio: -ce equivale a -c y después -e, -ud a -u y después -d
+        if (argc < 6 || strcmp(argv[4], "-k") != 0) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        unsigned long key_ul = strtoul(argv[5], NULL, 10);
+        unsigned char key = (unsigned char)(key_ul & 0xFF);
+
+        int num_hilos = 4;
+        if (argc >= 8 && strcmp(argv[6], "-t") == 0) {
+            num_hilos = atoi(argv[7]);
+            if (num_hilos < 1) num_hilos = 1;
+        }
+
+        // Las etapas se hablan por pipes, y la salida puede ser un pipe que se cierra antes:
+        // en los dos casos write() tiene que devolver EPIPE en lugar de terminar el proceso
+        signal(SIGPIPE, SIG_IGN);
+
+        if (strcmp(flag, "-ce") == 0) {
+            if (compress_encrypt(in_path, out_path, key, num_hilos) != 0) {
+                fprintf(stderr, "Error al comprimir y encriptar %s\n", in_path);
+                return EXIT_FAILURE;
+            }
+            fprintf(mensajes, "OK: %s -> %s (comprimido y encriptado, key=%u)\n", in_path, out_path, (unsigned)key);
+        } else {
+            if (decrypt_decompress(in_path, out_path, key, num_hilos) != 0) {
+                fprintf(stderr, "Error al desencriptar y descomprimir %s\n", in_path);
+                return EXIT_FAILURE;
+            }
+            fprintf(mensajes, "OK: %s -> %s (desencriptado y descomprimido, key=%u)\n", in_path, out_path, (unsigned)key);
+        }
+        return EXIT_SUCCESS;
+    }
     else {
         print_usage(argv[0]);
         return EXIT_FAILURE;
@@ -0,0 +1,123 @@
+// test_cesar.c - Prueba cada variante de la transformación César contra el bucle de a un byte
+// Se incluye cesar.c entero para poder llamar a las variantes (que son static) una por una.
+// Se corre con "make test".
+#include "../src/Cesar/cesar.c"
+
+typedef size_t (*cesar_kernel)(const unsigned char *, unsigned char *, size_t, unsigned char);
+
+// Lo que tiene que dar: sumar add a cada byte, de a uno
+static void reference(const unsigned char *src, unsigned char *dst, size_t len, unsigned char add){
+    for (size_t i = 0; i < len; i++){
+        dst[i] = (unsigned char)(src[i] + add);
+    }
+}
+
+// La variante procesa los vectores completos; el resto se completa de a un byte, como en
+// cesar_transform_buffer. kernel == NULL prueba cesar_transform_buffer entero (con su elección).
+static void run(cesar_kernel kernel, const unsigned char *src, unsigned char *dst, size_t len, unsigned char add){
+    if (!kernel){
+        cesar_transform_buffer(src, dst, len, add);
+        return;
+    }
+    size_t i = kernel(src, dst, len, add);
+    for (; i < len; i++){
+        dst[i] = (unsigned char)(src[i] + add);
+    }
+}
+
+// Bytes de más a cada lado de dst: la variante no tiene que tocarlos
+#define GUARD 64
+#define LARGE_MAX ((1 << 20) + 67)
+
+static int check(const char *name, cesar_kernel kernel, const unsigned char *src, size_t len,
+                 size_t src_off, size_t dst_off, unsigned char add, unsigned char *dst, unsigned char *expected){
+    memset(dst, 0xA5, len + dst_off + 2 * GUARD);
+    reference(src + src_off, expected, len, add);
+    run(kernel, src + src_off, dst + GUARD + dst_off, len, add);
+    if (memcmp(dst + GUARD + dst_off, expected, len) != 0){
+        fprintf(stderr, "FALLA %s: len=%zu src+%zu dst+%zu add=%u\n", name, len, src_off, dst_off, (unsigned)add);
+        return 1;
+    }
+    for (size_t g = 0; g < GUARD; g++){
+        if (dst[g] != 0xA5 || dst[GUARD + dst_off + len + g] != 0xA5){
+            fprintf(stderr, "FALLA %s: escribe fuera del buffer (len=%zu)\n", name, len);
+            return 1;
+        }
+    }
+    // En el mismo buffer (así la usa la lectura por bloques)
+    memcpy(dst + GUARD, src + src_off, len);
+    run(kernel, dst + GUARD, dst + GUARD, len, add);
+    if (memcmp(dst + GUARD, expected, len) != 0){
+        fprintf(stderr, "FALLA %s (en el lugar): len=%zu src+%zu add=%u\n", name, len, src_off, (unsigned)add);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_kernel(const char *name, cesar_kernel kernel, const unsigned char *src,
+                       unsigned char *dst, unsigned char *expected){
+    static const size_t large[] = { 4096, 4099, 65536 + 31, 1 << 20, LARGE_MAX };
+    int fails = 0;
+    for (int key = 0; key < 256 && !fails; key++){
+        // Encriptar suma key y desencriptar suma -key
+        unsigned char adds[2] = { (unsigned char)key, (unsigned char)-key };
+        for (int dir = 0; dir < 2 && !fails; dir++){
+            for (size_t len = 0; len <= 130 && !fails; len++){
+                for (size_t off = 0; off < 4 && !fails; off++){
+                    fails += check(name, kernel, src, len, off, (off * 3) % 4, adds[dir], dst, expected);
+                }
+            }
+            for (size_t j = 0; j < sizeof(large) / sizeof(large[0]) && !fails; j++){
+                fails += check(name, kernel, src, large[j], key % 3, 1, adds[dir], dst, expected);
+            }
+        }
+    }
+    printf("%s: %s\n", name, fails ? "FALLA" : "OK");
+    return fails;
+}
+
+int main(void){
+    unsigned char *src = malloc(LARGE_MAX + 8);
+    unsigned char *dst = malloc(LARGE_MAX + 8 + 2 * GUARD);
+    unsigned char *expected = malloc(LARGE_MAX + 8);
+    if (!src || !dst || !expected){
+        perror("malloc");
+        return 1;
+    }
+    // Todos los valores de byte, en un orden que no se repite cada 256
+    uint32_t x = 12345;
+    for (size_t i = 0; i < LARGE_MAX + 8; i++){
+        x = x * 1103515245u + 12345u;
+        src[i] = (unsigned char)(x >> 16);
+    }
+
+    int fails = 0;
+#ifdef __GNUC__
+    fails += test_kernel("vec16", cesar_add_vec16, src, dst, expected);
+#endif
+#if defined(CESAR_X86_DISPATCH)
+    if (__builtin_cpu_supports("avx2")){
+        fails += test_kernel("avx2", cesar_add_avx2, src, dst, expected);
+    }
+    else{
+        printf("%s: sin soporte en esta CPU, no se prueba\n", "avx2");
+    }
+    if (__builtin_cpu_supports("avx512bw")){
+        fails += test_kernel("avx512bw", cesar_add_avx512, src, dst, expected);
+    }
+    else{
+        printf("%s: sin soporte en esta CPU, no se prueba\n", "avx512bw");
+    }
+#endif
+    fails += test_kernel("elegida", NULL, src, dst, expected);
+
+    free(src);
+    free(dst);
+    free(expected);
+    if (fails){
+        printf("César: %d pruebas fallaron\n", fails);
+        return 1;
+    }
+    printf("César: todo OK\n");
+    return 0;
+}
@@ -0,0 +1,202 @@
+// test_huffman.c - Prueba el límite de longitud de los códigos y el decodificador por tablas
+// Se incluye huffman.c entero para poder llamar a build_lengths (que es static) directamente.
+// Se corre con "make test".
+#include "../src/Huffman/huffman.c"
+
+#include <sys/stat.h>
+
+// Frecuencias de Fibonacci: es el peor caso de Huffman, el árbol queda como una lista y el
+// símbolo menos frecuente termina con un código de nsym - 1 bits.
+static void fibonacci_freq(uint64_t freq[256], int nsym){
+    memset(freq, 0, 256 * sizeof(uint64_t));
+    uint64_t a = 1, b = 1;
+    for (int i = 0; i < nsym; i++){
+        freq[i] = a;
+        uint64_t c = a + b;
+        a = b;
+        b = c;
+    }
+}
+
+// Revisa que las longitudes respeten max_len, que estén todos los símbolos presentes y que el
+// código sea prefijo y completo (suma de Kraft exactamente 1, salvo con un solo símbolo).
+static int check_lengths(const char *name, const uint64_t freq[256], int max_len){
+    uint8_t lengths[256];
+    build_lengths(freq, lengths, max_len);
+
+    uint64_t kraft = 0;
+    int n = 0;
+    for (int i = 0; i < 256; i++){
+        if ((freq[i] > 0) != (lengths[i] > 0)){
+            fprintf(stderr, "FALLA %s: el byte %d tiene frecuencia %llu y longitud %u\n",
+                    name, i, (unsigned long long)freq[i], (unsigned)lengths[i]);
+            return 1;
+        }
+        if (lengths[i] == 0) continue;
+        if (lengths[i] > max_len){
+            fprintf(stderr, "FALLA %s: longitud %u con límite %d\n", name, (unsigned)lengths[i], max_len);
+            return 1;
+        }
+        kraft += (uint64_t)1 << (max_len - lengths[i]);
+        n++;
+    }
+    uint64_t full = (uint64_t)1 << max_len;
+    if (kraft > full || (n > 1 && kraft != full)){
+        fprintf(stderr, "FALLA %s: suma de Kraft %llu/%llu con límite %d\n",
+                name, (unsigned long long)kraft, (unsigned long long)full, max_len);
+        return 1;
+    }
+    Code codes[256];
+    if (build_canonical_codes(lengths, codes) != 0){
+        fprintf(stderr, "FALLA %s: no se pudieron armar los códigos canónicos\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_limits(void){
+    int fails = 0;
+    uint64_t freq[256];
+    uint8_t lengths[256];
+
+    // Sin recortar (límite de 63 bits) el árbol de Fibonacci tiene que pasarse de HUFF_MAX_CODE_LEN,
+    // si no la prueba no estaría ejercitando el recorte
+    fibonacci_freq(freq, 40);
+    build_lengths(freq, lengths, 63);
+    int deepest = 0;
+    for (int i = 0; i < 256; i++){
+        if (lengths[i] > deepest) deepest = lengths[i];
+    }
+    if (deepest <= HUFF_MAX_CODE_LEN){
+        fprintf(stderr, "FALLA: el caso de Fibonacci da códigos de %d bits, no supera el límite\n", deepest);
+        fails++;
+    }
+
+    for (int max_len = 8; max_len <= 15; max_len++){
+        for (int nsym = 2; nsym <= 60; nsym++){
+            fibonacci_freq(freq, nsym);
+            fails += check_lengths("fibonacci", freq, max_len);
+        }
+        // Los 256 bytes presentes: con max_len = 8 el único código posible es de 8 bits para todos
+        fibonacci_freq(freq, 60);
+        for (int i = 60; i < 256; i++) freq[i] = 1;
+        fails += check_lengths("256 símbolos", freq, max_len);
+        // Un solo símbolo
+        memset(freq, 0, sizeof(freq));
+        freq['a'] = 1000;
+        fails += check_lengths("un símbolo", freq, max_len);
+    }
+    printf("%s: %s\n", "longitudes limitadas", fails ? "FALLA" : "OK");
+    return fails;
+}
+
+static int write_file(const char *path, const uint8_t *data, size_t len){
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { perror(path); return -1; }
+    int r = write_all(fd, data, len);
+    close(fd);
+    return r;
+}
+
+// Lee el archivo entero; *len queda con su tamaño
+static uint8_t *read_file(const char *path, size_t *len){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return NULL; }
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror(path); close(fd); return NULL; }
+    uint8_t *data = malloc((size_t)st.st_size + 1);
+    size_t got = 0;
+    while (data && got < (size_t)st.st_size){
+        ssize_t r = read(fd, data + got, (size_t)st.st_size - got);
+        if (r <= 0) { free(data); data = NULL; break; }
+        got += (size_t)r;
+    }
+    close(fd);
+    *len = got;
+    return data;
+}
+
+// Comprime y descomprime data con compress_file/decompress_file y compara con el original
+static int roundtrip(const char *name, const char *dir, const uint8_t *data, size_t len){
+    char in[512], huff[512], out[512];
+    snprintf(in, sizeof(in), "%s/in", dir);
+    snprintf(huff, sizeof(huff), "%s/in.huff", dir);
+    snprintf(out, sizeof(out), "%s/out", dir);
+
+    int fails = 0;
+    if (write_file(in, data, len) != 0 || compress_file(in, huff) != 0 || decompress_file(huff, out) != 0){
+        fprintf(stderr, "FALLA %s: no se pudo comprimir o descomprimir\n", name);
+        fails = 1;
+    } else {
+        size_t got_len = 0;
+        uint8_t *got = read_file(out, &got_len);
+        if (!got || got_len != len || memcmp(got, data, len) != 0){
+            fprintf(stderr, "FALLA %s: lo descomprimido no coincide (%zu de %zu bytes)\n", name, got_len, len);
+            fails = 1;
+        }
+        free(got);
+    }
+    unlink(in);
+    unlink(huff);
+    unlink(out);
+    printf("%s: %s\n", name, fails ? "FALLA" : "OK");
+    return fails;
+}
+
+static int test_roundtrips(void){
+    char dir[] = "/tmp/test_huffman.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+
+    int fails = 0;
+    fails += roundtrip("archivo vacío", dir, (const uint8_t *)"", 0);
+
+    uint8_t one = 'x';
+    fails += roundtrip("un byte", dir, &one, 1);
+
+    size_t len = 100000;
+    uint8_t *data = malloc(len);
+    memset(data, 'a', len);
+    fails += roundtrip("un solo símbolo", dir, data, len);
+    free(data);
+
+    // Fibonacci con 26 símbolos: sin límite el menos frecuente tendría 25 bits. Los bytes se
+    // mezclan con un generador fijo para que los códigos largos queden repartidos por el archivo.
+    uint64_t freq[256];
+    fibonacci_freq(freq, 26);
+    len = 0;
+    for (int i = 0; i < 256; i++) len += freq[i];
+    data = malloc(len);
+    size_t pos = 0;
+    for (int i = 0; i < 256; i++){
+        for (uint64_t k = 0; k < freq[i]; k++) data[pos++] = (uint8_t)('A' + i);
+    }
+    uint32_t seed = 12345;
+    for (size_t i = len - 1; i > 0; i--){
+        seed = seed * 1103515245u + 12345u;
+        size_t j = seed % (i + 1);
+        uint8_t t = data[i]; data[i] = data[j]; data[j] = t;
+    }
+    fails += roundtrip("fibonacci mezclado", dir, data, len);
+
+    // Los 256 bytes, con algunos muy poco frecuentes al final
+    for (size_t i = 0; i < len; i++){
+        if (i % 997 == 0) data[i] = (uint8_t)(i / 997);
+    }
+    fails += roundtrip("256 bytes", dir, data, len);
+    free(data);
+
+    rmdir(dir);
+    return fails;
+}
+
+int main(void){
+    int fails = 0;
+    fails += test_limits();
+    fails += test_roundtrips();
+    if (fails){
+        printf("Huffman: %d pruebas fallaron\n", fails);
+        return 1;
+    }
+    printf("Huffman: todo OK (HUFF_MAX_CODE_LEN = %d)\n", HUFF_MAX_CODE_LEN);
+    return 0;
+}
@@ -0,0 +1,167 @@
+#!/bin/sh
+# test_update.sh - Prueba -c --update sobre un .har, los duplicados entre actualizaciones y la
+# lectura de los índices anteriores (GSHARIDX)
+# Uso: tests/test_update.sh ./gsea   (lo corre "make test")
+GSEA=${1:-./gsea}
+case "$GSEA" in /*) ;; *) GSEA="$(pwd)/$GSEA" ;; esac
+FIXTURES="$(cd "$(dirname "$0")" && pwd)/fixtures"
+
+TMP=$(mktemp -d /tmp/test_update.XXXXXX) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+FAILS=0
+
+fail() {
+    echo "FALLA: $*" >&2
+    FAILS=$((FAILS + 1))
+}
+
+# Texto repetible de n líneas; la semilla cambia el contenido
+gen_text() {
+    awk -v n="$1" -v seed="$2" 'BEGIN { for (i = 0; i < n; i++) printf "%d linea %d del archivo de prueba %d\n", seed, i, (i * seed) % 977 }'
+}
+
+# "tamaño ruta" de cada archivo de la carpeta, ordenado por ruta
+tree_listing() {
+    (cd "$1" && find . -type f | sed 's|^\./||' | sort | while read -r f; do
+        echo "$(wc -c < "$f" | tr -d ' ') $f"
+    done)
+}
+
+# Lo mismo según "gsea -l"
+har_listing() {
+    "$GSEA" -l "$1" | awk 'NR > 1 { print $1, $3 }' | sort -k2
+}
+
+# Descomprime el .har entero y lo compara con la carpeta, también con -l
+check_archive() {
+    name=$1; har=$2; dir=$3
+    rm -rf "$TMP/out"
+    if ! "$GSEA" -d "$har" "$TMP/out" -t 4 > /dev/null; then
+        fail "$name: -d falló"
+        return
+    fi
+    diff -r "$dir" "$TMP/out" > /dev/null || fail "$name: lo extraído con -d no coincide con la carpeta"
+    tree_listing "$dir" > "$TMP/expected.txt"
+    har_listing "$har" > "$TMP/listed.txt"
+    cmp -s "$TMP/expected.txt" "$TMP/listed.txt" || fail "$name: -l no coincide con la carpeta"
+}
+
+# Corre --update (con las opciones que sigan) y revisa cuántos archivos se copiaron del .har
+# anterior y cuántos se comprimieron
+update() {
+    name=$1; dir=$2; har=$3; copied=$4; compressed=$5
+    shift 5
+    if ! "$GSEA" -c "$dir" "$har" --update "$@" -t 4 > "$TMP/update.txt"; then
+        fail "$name: --update falló"
+        return
+    fi
+    grep -q "^$copied archivos sin cambios copiados, $compressed comprimidos$" "$TMP/update.txt" \
+        || fail "$name: se esperaban $copied copiados y $compressed comprimidos: $(grep copiados "$TMP/update.txt")"
+}
+
+# 1. Carpeta de prueba: chicos, uno vacío, uno de varios bloques y una subcarpeta
+T="$TMP/tree"
+mkdir -p "$T/sub/deep"
+gen_text 200 1 > "$T/cambia.txt"
+gen_text 300 2 > "$T/igual.txt"
+gen_text 100 3 > "$T/sub/borrar.txt"
+gen_text 400 4 > "$T/sub/deep/igual2.txt"
+gen_text 60000 5 > "$T/grande.txt"     # más de un bloque de Huffman
+: > "$T/vacio.txt"
+"$GSEA" -c "$T" "$TMP/a.har" -t 4 > /dev/null || fail "no se pudo crear el .har"
+check_archive "creado" "$TMP/a.har" "$T"
+
+# 2. Sin cambios: todo se copia
+update "sin cambios" "$T" "$TMP/a.har" 6 0
+check_archive "sin cambios" "$TMP/a.har" "$T"
+
+# 3. Un archivo reescrito con el mismo tamaño y en el mismo segundo (solo cambian los
+#    nanosegundos del mtime), uno nuevo, uno borrado y uno grande modificado
+sec=$(stat -c %Y "$T/cambia.txt")
+gen_text 200 1 | tr 'a' 'b' > "$T/cambia.txt"
+touch -d "@$sec.5" "$T/cambia.txt"
+gen_text 50 6 > "$T/sub/nuevo.txt"
+rm "$T/sub/borrar.txt"
+gen_text 60000 7 > "$T/grande.txt"
+update "modificado" "$T" "$TMP/a.har" 3 3
+check_archive "modificado" "$TMP/a.har" "$T"
+
+# 4. Se puede seguir actualizando el resultado
+rm "$T/igual.txt"
+update "otra vez" "$T" "$TMP/a.har" 5 0
+check_archive "otra vez" "$TMP/a.har" "$T"
+
+# 5. Índice anterior (GSHARIDX, mtime sin nanosegundos): fixtures/legacy_gsharidx.bin se armó
+#    con la carpeta de abajo, con todos los mtime en 1700000000.
+L="$TMP/legacy"
+mkdir -p "$L/dir"
+gen_text 100 11 > "$L/uno.txt"
+gen_text 150 12 > "$L/dir/dos.txt"
+gen_text 80 13 > "$L/dir/tres.txt"
+find "$L" -type f -exec touch -d @1700000000 {} +
+cp "$FIXTURES/legacy_gsharidx.bin" "$TMP/legacy.har"
+check_archive "índice GSHARIDX" "$TMP/legacy.har" "$L"
+"$GSEA" -x "$TMP/legacy.har" dir/dos.txt "$TMP/dos.txt" > /dev/null && cmp -s "$TMP/dos.txt" "$L/dir/dos.txt" \
+    || fail "índice GSHARIDX: -x no extrae dir/dos.txt"
+gen_text 90 14 > "$L/dir/tres.txt"
+update "índice GSHARIDX" "$L" "$TMP/legacy.har" 2 1
+check_archive "índice GSHARIDX actualizado" "$TMP/legacy.har" "$L"
+tail -c 8 "$TMP/legacy.har" | grep -q GSHARIX3 || fail "índice GSHARIDX: --update no escribió el índice nuevo"
+
+# 6. Duplicados: --update los sigue guardando una sola vez sin volver a leer los que no cambiaron
+#    (usa el hash del índice), así que el .har queda igual de chico que uno hecho de cero
+D="$TMP/dups"
+mkdir -p "$D/sub"
+gen_text 300 21 > "$D/a.txt"
+cp "$D/a.txt" "$D/sub/copia_a.txt"
+gen_text 60000 22 > "$D/grande.txt"
+cp "$D/grande.txt" "$D/sub/grande_copia.txt"
+gen_text 100 23 > "$D/b.txt"
+head -c 300000 /dev/urandom > "$D/azar.bin"      # no se comprime: va tal cual (ENTRY_RAW)
+cp "$D/azar.bin" "$D/sub/azar_copia.bin"
+: > "$D/vacio1.txt"
+: > "$D/sub/vacio2.txt"
+"$GSEA" -c "$D" "$TMP/dups.har" -t 4 > /dev/null || fail "duplicados: no se pudo crear el .har"
+fresh=$(wc -c < "$TMP/dups.har")
+update "duplicados sin cambios" "$D" "$TMP/dups.har" 9 0
+check_archive "duplicados sin cambios" "$TMP/dups.har" "$D"
+[ "$(wc -c < "$TMP/dups.har")" -eq "$fresh" ] || fail "duplicados sin cambios: el .har creció de $fresh a $(wc -c < "$TMP/dups.har") bytes"
+
+# Una copia nueva de un archivo sin cambios apunta a su payload copiado
+cp "$D/grande.txt" "$D/grande_otra.txt"
+cp "$D/b.txt" "$D/sub/b_copia.txt"
+update "copia nueva" "$D" "$TMP/dups.har" 9 2
+check_archive "copia nueva" "$TMP/dups.har" "$D"
+"$GSEA" -c "$D" "$TMP/dups_fresh.har" -t 4 > /dev/null || fail "copia nueva: no se pudo crear el .har de cero"
+[ "$(wc -c < "$TMP/dups.har")" -eq "$(wc -c < "$TMP/dups_fresh.har")" ] \
+    || fail "copia nueva: el .har actualizado no quedó del tamaño de uno hecho de cero"
+
+# Una entrada tal cual extraída a stdout abierto con O_APPEND (sendfile no sirve ahí)
+: > "$TMP/azar.out"
+"$GSEA" -x "$TMP/dups.har" azar.bin - >> "$TMP/azar.out" 2> /dev/null && cmp -s "$TMP/azar.out" "$D/azar.bin" \
+    || fail "-x de una entrada tal cual a stdout con >> no coincide"
+
+# 7. --solid con --update sigue con la tabla del .har anterior: las entradas que la usan
+#    también se copian, y lo nuevo se comprime con esa misma tabla
+S="$TMP/solid"
+mkdir -p "$S/sub"
+for i in 1 2 3 4 5 6; do gen_text 40 "3$i" > "$S/chico$i.txt"; done
+gen_text 40 37 > "$S/sub/chico7.txt"
+gen_text 60000 38 > "$S/grande.txt"
+"$GSEA" -c "$S" "$TMP/solid.har" --solid -t 4 > /dev/null || fail "--solid: no se pudo crear el .har"
+check_archive "--solid" "$TMP/solid.har" "$S"
+fresh=$(wc -c < "$TMP/solid.har")
+update "--solid sin cambios" "$S" "$TMP/solid.har" 8 0 --solid
+[ "$(wc -c < "$TMP/solid.har")" -eq "$fresh" ] || fail "--solid sin cambios: el .har cambió de tamaño"
+gen_text 40 39 > "$S/chico1.txt"
+update "--solid modificado" "$S" "$TMP/solid.har" 7 1 --solid
+check_archive "--solid modificado" "$TMP/solid.har" "$S"
+# Sin --solid ya no hay tabla: lo que la usaba se vuelve a comprimir
+update "--solid sin --solid" "$S" "$TMP/solid.har" 1 7
+check_archive "--solid sin --solid" "$TMP/solid.har" "$S"
+
+if [ "$FAILS" -ne 0 ]; then
+    echo "--update: $FAILS pruebas fallaron"
+    exit 1
+fi
+echo "--update: todo OK"